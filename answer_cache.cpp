@@ -0,0 +1,102 @@
+/**
+ * @file answer_cache.cpp
+ * @author Albert Kharisov <albkharisov@gmail.com>
+ * @version 1.0
+ *
+ * @brief Bounded concurrent cache of the formatted roots.
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <ostream>
+#include "answer_cache.hpp"
+
+
+namespace {
+
+/** Round up to power of 2 */
+std::size_t round_up(std::size_t n) {
+    std::size_t p = 1;
+    while (p < n) { p <<= 1; }
+    return p;
+}
+
+} // namespace
+
+
+std::size_t AnswerCache::Hash::operator()(const Key& key) const noexcept {
+    // multiply-xorshift, every input bit reaches the top bits picking the shard
+    std::uint64_t h = static_cast<std::uint32_t>(key.a);
+    h = (h << 32) ^ static_cast<std::uint32_t>(key.b);
+    h ^= static_cast<std::uint64_t>(static_cast<std::uint32_t>(key.c)) * 0x9e3779b97f4a7c15ull;
+    h ^= h >> 29;
+    h *= 0xbf58476d1ce4e5b9ull;
+    h ^= h >> 32;
+    return static_cast<std::size_t>(h);
+}
+
+AnswerCache::AnswerCache(std::size_t capacity, std::size_t shards)
+        : shard_count(round_up(shards ? shards : 1)),
+          shard_capacity(std::max<std::size_t>(1, (capacity + shard_count - 1) / shard_count)),
+          shards(std::make_unique<Shard[]>(shard_count)) {}
+
+std::size_t AnswerCache::write(int a, int b, int c, const Roots* roots, char* buf) {
+    const Key key{a, b, c};
+    const auto h = Hash()(key);
+    auto& shard = shards[(h >> 16) & (shard_count - 1)];
+
+    {
+        std::lock_guard<std::mutex> l(shard.m);
+        const auto it = shard.entries.find(key);
+        if (it != shard.entries.end()) {
+            ++shard.hits;
+            std::memcpy(buf, it->second.text.data(), it->second.size);
+            return it->second.size;
+        }
+        ++shard.misses;
+    }
+
+    // solved out of the lock, a racing miss adds the same answer
+    Entry entry;
+    entry.size = static_cast<unsigned char>(format_roots(roots ? *roots : solve_square_equation(a, b, c),
+                                                         entry.text.data()));
+    std::memcpy(buf, entry.text.data(), entry.size);
+
+    std::lock_guard<std::mutex> l(shard.m);
+    if (shard.entries.size() >= shard_capacity && !shard.entries.count(key)) {
+        shard.entries.erase(shard.entries.begin());
+        ++shard.evictions;
+    }
+    shard.entries.emplace(key, entry);
+    return entry.size;
+}
+
+std::size_t AnswerCache::write_answer(std::string_view a_str, std::string_view b_str, std::string_view c_str,
+                                      char* buf) {
+    int a, b, c;
+    const auto status = parse_coefficients(a_str, b_str, c_str, a, b, c);
+    if (status != ParseStatus::ok) { return format_answer(a_str, b_str, c_str, status, Roots{}, buf); }
+
+    const auto echo = format_echo(a_str, b_str, c_str, buf);
+    return echo + write_roots(a, b, c, buf + echo);
+}
+
+CacheStats AnswerCache::stats() const {
+    CacheStats s;
+    for (std::size_t i = 0; i < shard_count; ++i) {
+        auto& shard = shards[i];
+        std::lock_guard<std::mutex> l(shard.m);
+        s.hits += shard.hits;
+        s.misses += shard.misses;
+        s.evictions += shard.evictions;
+        s.size += shard.entries.size();
+    }
+    return s;
+}
+
+std::ostream& operator<<(std::ostream& out, const CacheStats& stats) {
+    const auto lookups = stats.hits + stats.misses;
+    return out << "cache: hits " << stats.hits << ", misses " << stats.misses
+               << ", hit rate " << (lookups ? 100. * stats.hits / lookups : 0.) << "%"
+               << ", evictions " << stats.evictions << ", entries " << stats.size << std::endl;
+}
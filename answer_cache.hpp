@@ -0,0 +1,137 @@
+/**
+ * @file answer_cache.hpp
+ * @author Albert Kharisov <albkharisov@gmail.com>
+ * @version 1.0
+ *
+ * @brief Bounded concurrent cache of the formatted roots.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <unordered_map>
+#include "result_ring.hpp"
+#include "square_solver.hpp"
+
+/**
+ * @brief Snapshot of the counters of the cache.
+ */
+struct CacheStats {
+    /** Lookups found in the cache */
+    std::uint64_t hits = 0;
+    /** Lookups solved and added to the cache */
+    std::uint64_t misses = 0;
+    /** Entries dropped to make room for the new ones */
+    std::uint64_t evictions = 0;
+    /** Entries in the cache */
+    std::size_t size = 0;
+};
+
+/** Print the snapshot in a human readable form */
+std::ostream& operator<<(std::ostream& out, const CacheStats& stats);
+
+/**
+ * @brief Cache of the answers after the coefficients echo, keyed by
+ * the parsed coefficients.
+ *
+ * Split into shards with their own mutex, so threads looking up
+ * different equations rarely meet. Every shard holds at most its share
+ * of the capacity, a full shard drops an arbitrary entry. Answers to
+ * the invalid input don't depend on the coefficients, so they aren't cached.
+ */
+class AnswerCache {
+    /** Parsed coefficients */
+    struct Key {
+        /** Parameter a */
+        int a;
+        /** Parameter b */
+        int b;
+        /** Parameter c */
+        int c;
+        /** Compare keys */
+        bool operator==(const Key& other) const { return a == other.a && b == other.b && c == other.c; }
+    };
+
+    /** Hash of the key, also picks the shard */
+    struct Hash {
+        std::size_t operator()(const Key& key) const noexcept;
+    };
+
+    /** Formatted roots */
+    struct Entry {
+        /** Number of chars */
+        unsigned char size;
+        /** The chars */
+        std::array<char, answer_tail_size> text;
+    };
+
+    /** Part of the cache under one mutex */
+    struct alignas(cache_line_size) Shard {
+        /** Mutex for everything in the shard */
+        std::mutex m;
+        /** Cached answers */
+        std::unordered_map<Key, Entry, Hash> entries;
+        /** See CacheStats::hits */
+        std::uint64_t hits = 0;
+        /** See CacheStats::misses */
+        std::uint64_t misses = 0;
+        /** See CacheStats::evictions */
+        std::uint64_t evictions = 0;
+    };
+
+    /** Number of shards, power of 2 */
+    const std::size_t shard_count;
+    /** Most entries in one shard */
+    const std::size_t shard_capacity;
+    /** The shards */
+    std::unique_ptr<Shard[]> shards;
+
+    /** Look up the roots, format `*roots` or solve the equation on a miss */
+    std::size_t write(int a, int b, int c, const Roots* roots, char* buf);
+
+public:
+    /**
+     * A constructor.
+     *
+     * @param capacity most entries in the cache
+     * @param shards number of shards, rounded up to power of 2
+     */
+    explicit AnswerCache(std::size_t capacity, std::size_t shards = 64);
+
+    /**
+     * Write the roots the way `format_roots()` does,
+     * solving the equation only if it's not cached.
+     *
+     * @param buf where to write, has to fit `answer_tail_size` chars
+     * @return number of chars written
+     */
+    std::size_t write_roots(int a, int b, int c, char* buf) { return write(a, b, c, nullptr, buf); }
+
+    /**
+     * Write already solved roots, formatting them only if they are not cached.
+     *
+     * @param roots solution of the equation
+     * @param buf where to write, has to fit `answer_tail_size` chars
+     * @return number of chars written
+     */
+    std::size_t write_roots(int a, int b, int c, const Roots& roots, char* buf) {
+        return write(a, b, c, &roots, buf);
+    }
+
+    /**
+     * Same answer as `write_square_roots()` writes, with the roots from the cache.
+     *
+     * @param buf where to write the answer, has to fit `answer_size()` chars
+     * @return number of chars written
+     */
+    std::size_t write_answer(std::string_view a_str, std::string_view b_str, std::string_view c_str, char* buf);
+
+    /** Read the counters */
+    CacheStats stats() const;
+};
@@ -0,0 +1,602 @@
+/**
+ * @file bench.cpp
+ * @author Albert Kharisov <albkharisov@gmail.com>
+ * @version 1.0
+ *
+ * @brief Benchmarks of the worker pool and the solver.
+ *
+ * Pool benchmark measures jobs per second and submit-to-answer latency
+ * for every scheduling and completion mode across thread counts and
+ * job sizes. Layout benchmark compares the pool state packed together
+ * with the state split into cache line regions. Solver benchmark
+ * measures time per equation on valid, invalid and overflowing input.
+ * Results are printed as CSV or JSON.
+ *
+ * Also generates large synthetic inputs for se_solver.
+ */
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <utility>
+#include <vector>
+#include "worker_pool.hpp"
+#include "binary_format.hpp"
+#include "square_solver.hpp"
+
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+/**
+ * @brief Collects result rows and prints them as CSV or JSON.
+ */
+class Report {
+    /** Row is a list of column name and value pairs */
+    using Row = std::vector<std::pair<std::string, std::string>>;
+    /** All collected rows */
+    std::vector<Row> rows;
+    /** Print JSON instead of CSV */
+    const bool json;
+
+public:
+    /** A constructor */
+    explicit Report(bool as_json) : json(as_json) {}
+
+    /** Start new row */
+    Report& row() {
+        rows.emplace_back();
+        return *this;
+    }
+
+    /** Add string column to the last row */
+    Report& col(const char* name, std::string value) {
+        rows.back().emplace_back(name, std::move(value));
+        return *this;
+    }
+
+    /** Add numeric column to the last row */
+    Report& col(const char* name, double value) {
+        char buf[32];
+        std::snprintf(buf, sizeof(buf), "%.6g", value);
+        return col(name, std::string(buf));
+    }
+
+    /** Print all rows, CSV header is taken from the first row of each kind */
+    void print() const {
+        if (json) {
+            std::printf("[\n");
+            for (std::size_t i = 0; i < rows.size(); ++i) {
+                std::printf("  {");
+                for (std::size_t j = 0; j < rows[i].size(); ++j) {
+                    const auto& [name, value] = rows[i][j];
+                    const bool number = !value.empty() && (std::isdigit(value[0]) || value[0] == '-');
+                    std::printf("%s\"%s\": %s%s%s", j ? ", " : "", name.c_str(),
+                                number ? "" : "\"", value.c_str(), number ? "" : "\"");
+                }
+                std::printf("}%s\n", i + 1 < rows.size() ? "," : "");
+            }
+            std::printf("]\n");
+            return;
+        }
+
+        const Row* header = nullptr;
+        for (const auto& r : rows) {
+            bool same = header && header->size() == r.size();
+            for (std::size_t j = 0; same && j < r.size(); ++j) {
+                same = (*header)[j].first == r[j].first;
+            }
+            if (!same) {
+                header = &r;
+                for (std::size_t j = 0; j < r.size(); ++j) {
+                    std::printf("%s%s", j ? "," : "", r[j].first.c_str());
+                }
+                std::printf("\n");
+            }
+            for (std::size_t j = 0; j < r.size(); ++j) {
+                std::printf("%s%s", j ? "," : "", r[j].second.c_str());
+            }
+            std::printf("\n");
+        }
+    }
+};
+
+/** Name of the scheduling mode */
+const char* name(Scheduling s) {
+    switch (s) {
+    case Scheduling::fifo: return "fifo";
+    case Scheduling::work_stealing: return "work_stealing";
+    case Scheduling::lock_free: return "lock_free";
+    }
+    return "?";
+}
+
+/** Name of the completion mode */
+const char* name(Completion c) {
+    switch (c) {
+    case Completion::futures: return "futures";
+    case Completion::ring: return "ring";
+    case Completion::batched: return "batched";
+    case Completion::unordered: return "unordered";
+    }
+    return "?";
+}
+
+/**
+ * Job of the pool benchmark: some math to simulate the work.
+ *
+ * @param spins amount of work
+ * @return answer for the ordered queue
+ */
+WorkerPool::Answer busy_job(unsigned spins) {
+    double x = spins;
+    for (unsigned i = 0; i < spins; ++i) {
+        x = std::sqrt(x + i);
+    }
+    // keep the answer short, so it doesn't allocate
+    return x < 0 ? "-" : "+";
+}
+
+/** Percentile of the sorted samples in microseconds */
+double percentile(const std::vector<Clock::duration>& sorted, double p) {
+    if (sorted.empty()) { return 0; }
+    auto idx = static_cast<std::size_t>(p * (sorted.size() - 1));
+    return std::chrono::duration<double, std::micro>(sorted[idx]).count();
+}
+
+/**
+ * @brief Parameters of one pool benchmark run.
+ */
+struct PoolCase {
+    /** Number of workers */
+    unsigned threads;
+    /** Pool options */
+    WorkerPoolOptions options;
+    /** Work per job, see `busy_job()` */
+    unsigned spins;
+    /** Number of jobs to run */
+    std::size_t jobs;
+};
+
+/** Jobs set at once in Completion::batched mode */
+constexpr std::size_t bench_batch = 64;
+
+/**
+ * Run jobs through the pool: current thread submits,
+ * separate thread collects answers.
+ * In Completion::batched mode jobs are set by `bench_batch`.
+ */
+void bench_pool(const PoolCase& c, Report& report) {
+    std::vector<Clock::time_point> submitted(c.jobs);
+    std::vector<Clock::duration> latency(c.jobs);
+
+    const auto start = Clock::now();
+    {
+        WorkerPool pool(c.threads, c.options);
+        std::thread consumer([&pool, &submitted, &latency] {
+            while (auto answer = pool.get_tagged_answer()) {
+                latency[answer->seq] = Clock::now() - submitted[answer->seq];
+            }
+        });
+
+        if (c.options.completion == Completion::batched) {
+            const std::vector<std::tuple<unsigned>> args(bench_batch, std::make_tuple(c.spins));
+            for (std::size_t i = 0; i < c.jobs; i += bench_batch) {
+                const auto n = std::min(bench_batch, c.jobs - i);
+                std::fill_n(submitted.begin() + i, n, Clock::now());
+                pool.set_jobs(busy_job, args.begin(), args.begin() + n);
+            }
+        } else {
+            for (std::size_t i = 0; i < c.jobs; ++i) {
+                submitted[i] = Clock::now();
+                pool.set_job(busy_job, c.spins);
+            }
+        }
+        pool.stop();
+        consumer.join();
+    }
+    const std::chrono::duration<double> elapsed = Clock::now() - start;
+
+    std::sort(latency.begin(), latency.end());
+    report.row()
+          .col("bench", "pool")
+          .col("scheduling", name(c.options.scheduling))
+          .col("completion", name(c.options.completion))
+          .col("threads", c.threads)
+          .col("idle_spins", c.options.idle.spins)
+          .col("spins", c.spins)
+          .col("jobs", static_cast<double>(c.jobs))
+          .col("jobs_per_sec", c.jobs / elapsed.count())
+          .col("p50_us", percentile(latency, 0.5))
+          .col("p99_us", percentile(latency, 0.99));
+}
+
+/**
+ * @brief Shared state of the pool before it was split into regions:
+ * producer, consumer and worker fields packed together.
+ */
+struct PackedState {
+    /** Per-worker flag, polled by the worker, next to what it writes */
+    struct Slot {
+        std::atomic<bool> stop{false};
+        std::uint64_t done = 0;
+    };
+
+    std::mutex m_jobs;
+    std::size_t queued = 0;
+    std::mutex m_results;
+    std::size_t answers = 0;
+    std::atomic<std::size_t> pending{0};
+    std::vector<Slot> slots;
+};
+
+/**
+ * @brief Same state as `PackedState` laid out the way WorkerPool is:
+ * producer side, job counters, consumer side and every worker on lines of their own.
+ */
+struct SplitState {
+    /** Per-worker flag and the worker's own fields on separate lines */
+    struct alignas(cache_line_size) Slot {
+        std::atomic<bool> stop{false};
+        alignas(cache_line_size) std::uint64_t done = 0;
+    };
+
+    alignas(cache_line_size) std::mutex m_jobs;
+    std::size_t queued = 0;
+    alignas(cache_line_size) std::mutex m_results;
+    std::size_t answers = 0;
+    alignas(cache_line_size) std::atomic<std::size_t> pending{0};
+    std::vector<Slot> slots;
+};
+
+/** Most jobs the producer of the layout benchmark gets ahead */
+constexpr std::size_t layout_window = 1024;
+
+/**
+ * Move jobs through the hot fields of the pool without running anything:
+ * current thread queues under `m_jobs` and bumps `pending`, workers claim
+ * jobs from `pending`, take them under `m_jobs` and deliver under `m_results`,
+ * separate thread collects the answers. Only the layout differs between states.
+ *
+ * @return jobs per second
+ */
+template <typename State>
+double layout_jobs_per_sec(unsigned threads, std::size_t jobs) {
+    State state;
+    state.slots = decltype(state.slots)(threads);
+
+    const auto start = Clock::now();
+    std::vector<std::thread> workers;
+    for (unsigned w = 0; w < threads; ++w) {
+        workers.emplace_back([&state, w] {
+            auto& slot = state.slots[w];
+            while (!slot.stop.load(std::memory_order_relaxed)) {
+                auto n = state.pending.load(std::memory_order_acquire);
+                if (!n || !state.pending.compare_exchange_weak(n, n - 1, std::memory_order_acq_rel)) {
+                    std::this_thread::yield();
+                    continue;
+                }
+                { std::lock_guard<std::mutex> l(state.m_jobs); --state.queued; }
+                ++slot.done;
+                std::lock_guard<std::mutex> l(state.m_results);
+                ++state.answers;
+            }
+        });
+    }
+
+    std::thread consumer([&state, jobs] {
+        for (std::size_t taken = 0; taken < jobs; ) {
+            {
+                std::lock_guard<std::mutex> l(state.m_results);
+                taken += state.answers;
+                state.answers = 0;
+            }
+            std::this_thread::yield();
+        }
+        for (auto& slot : state.slots) { slot.stop.store(true, std::memory_order_relaxed); }
+    });
+
+    for (std::size_t i = 0; i < jobs; ++i) {
+        while (state.pending.load(std::memory_order_relaxed) >= layout_window) { std::this_thread::yield(); }
+        { std::lock_guard<std::mutex> l(state.m_jobs); ++state.queued; }
+        state.pending.fetch_add(1, std::memory_order_release);
+    }
+
+    consumer.join();
+    for (auto& t : workers) { t.join(); }
+    const std::chrono::duration<double> elapsed = Clock::now() - start;
+    return jobs / elapsed.count();
+}
+
+/** Compare the packed and the split layout of the pool state */
+void bench_layout(unsigned threads, std::size_t jobs, Report& report) {
+    const std::pair<const char*, double (*)(unsigned, std::size_t)> layouts[] = {
+        {"packed", layout_jobs_per_sec<PackedState>},
+        {"split", layout_jobs_per_sec<SplitState>},
+    };
+    for (auto [layout, run] : layouts) {
+        report.row()
+              .col("bench", "layout")
+              .col("layout", layout)
+              .col("threads", threads)
+              .col("jobs", static_cast<double>(jobs))
+              .col("jobs_per_sec", run(threads, jobs));
+    }
+}
+
+/** Equation coefficients as strings */
+using Equation = std::array<std::string, 3>;
+
+/**
+ * Make input of the given kind.
+ *
+ * @param kind "valid", "invalid" or "overflow"
+ * @param n number of equations
+ */
+std::vector<Equation> make_equations(const std::string& kind, std::size_t n) {
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<int> coef(-10000, 10000);
+    std::vector<Equation> eqs(n);
+    for (auto& e : eqs) {
+        for (auto& s : e) { s = std::to_string(coef(rng)); }
+        if (kind == "invalid") {
+            e[rng() % 3] = "awef";
+        } else if (kind == "overflow") {
+            e[rng() % 3] = "8598583333333333333333333";
+        }
+    }
+    return eqs;
+}
+
+/** Time per call in nanoseconds */
+template <typename F>
+double time_per_call(std::size_t n, F&& f) {
+    const auto start = Clock::now();
+    for (std::size_t i = 0; i < n; ++i) { f(i); }
+    return std::chrono::duration<double, std::nano>(Clock::now() - start).count() / n;
+}
+
+/** Measure all solver entry points on input of the given kind */
+void bench_solver(const std::string& kind, std::size_t n, Report& report) {
+    const auto eqs = make_equations(kind, n);
+    std::size_t sink = 0;
+
+    auto add = [&report, &kind, n](const char* func, double ns) {
+        report.row()
+              .col("bench", "solver")
+              .col("function", func)
+              .col("input", kind)
+              .col("equations", static_cast<double>(n))
+              .col("ns_per_equation", ns);
+    };
+
+    add("calculate_square_roots", time_per_call(n, [&](std::size_t i) {
+        sink += calculate_square_roots(eqs[i][0], eqs[i][1], eqs[i][2]).size();
+    }));
+
+    char buf[256];
+    add("write_square_roots", time_per_call(n, [&](std::size_t i) {
+        sink += write_square_roots(eqs[i][0], eqs[i][1], eqs[i][2], buf, sizeof(buf)).size;
+    }));
+
+    if (kind == "valid") {
+        std::vector<int> a(n), b(n), c(n);
+        for (std::size_t i = 0; i < n; ++i) {
+            parse_coefficient(eqs[i][0], a[i]);
+            parse_coefficient(eqs[i][1], b[i]);
+            parse_coefficient(eqs[i][2], c[i]);
+        }
+        std::vector<Roots> roots(n);
+        const std::pair<SimdLevel, const char*> levels[] = {
+            {SimdLevel::scalar, "solve_square_equations/scalar"},
+            {SimdLevel::avx2, "solve_square_equations/avx2"},
+            {SimdLevel::avx512, "solve_square_equations/avx512"},
+        };
+        for (auto [level, func] : levels) {
+            if (level > simd_level()) { continue; }
+            add(func, time_per_call(1, [&](std::size_t) {
+                solve_square_equations(a.data(), b.data(), c.data(), n, roots.data(), level);
+            }) / n);
+            sink += roots[n / 2].kind == RootsKind::two;
+        }
+
+        std::vector<BinaryEquation> packed(n);
+        for (std::size_t i = 0; i < n; ++i) { packed[i] = {a[i], b[i], c[i]}; }
+        std::vector<BinaryAnswer> answers(n);
+        add("solve_binary", time_per_call(1, [&](std::size_t) {
+            solve_binary(reinterpret_cast<const char*>(packed.data()), n, reinterpret_cast<char*>(answers.data()));
+        }) / n);
+        sink += answers[n / 2].kind;
+    }
+
+    if (sink == 42) { std::fprintf(stderr, "\n"); }
+}
+
+/**
+ * Print synthetic input: mostly valid coefficients of different
+ * magnitude, with garbage and overflowing tokens mixed in.
+ *
+ * @param n number of equations
+ * @param seed random seed
+ */
+void generate(std::size_t n, unsigned seed) {
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<int> small(-100, 100);
+    std::uniform_int_distribution<int> large(-2000000000, 2000000000);
+    const char* garbage[] = {"awef", "82-436", "9209y", "[qjg", "2[p4og", "a"};
+
+    std::string line;
+    for (std::size_t i = 0; i < 3 * n; ++i) {
+        const auto roll = rng() % 100;
+        if (roll < 70) {
+            line += std::to_string(small(rng));
+        } else if (roll < 90) {
+            line += std::to_string(large(rng));
+        } else if (roll < 97) {
+            line += garbage[rng() % std::size(garbage)];
+        } else {
+            line += "8598583333333333333333333";
+        }
+        line += (i % 12 == 11) ? '\n' : ' ';
+        if (line.size() > (1 << 16)) {
+            std::fwrite(line.data(), 1, line.size(), stdout);
+            line.clear();
+        }
+    }
+    line += '\n';
+    std::fwrite(line.data(), 1, line.size(), stdout);
+}
+
+/**
+ * Print synthetic input for `se_solver --binary`: packed coefficients
+ * of different magnitude.
+ *
+ * @param n number of equations
+ * @param seed random seed
+ */
+void generate_binary(std::size_t n, unsigned seed) {
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<int> small(-100, 100);
+    std::uniform_int_distribution<int> large(-2000000000, 2000000000);
+
+    std::vector<BinaryEquation> records;
+    records.reserve(4096);
+    for (std::size_t i = 0; i < n; ++i) {
+        auto coef = [&] { return rng() % 100 < 75 ? small(rng) : large(rng); };
+        const int a = coef(), b = coef(), c = coef();
+        records.push_back({a, b, c});
+        if (records.size() == records.capacity() || i + 1 == n) {
+            std::fwrite(records.data(), sizeof(BinaryEquation), records.size(), stdout);
+            records.clear();
+        }
+    }
+}
+
+/** Parse comma separated list of numbers */
+std::vector<unsigned> parse_list(const char* s) {
+    std::vector<unsigned> list;
+    for (char* end; *s; s = (*end == ',') ? end + 1 : end) {
+        list.push_back(std::strtoul(s, &end, 10));
+        if (end == s) { break; }
+    }
+    return list;
+}
+
+/** Print usage and exit */
+[[noreturn]] void usage(const char* prog) {
+    std::fprintf(stderr,
+        "usage: %s [--format csv|json] [--only pool|layout|solver] [--jobs N] [--threads 1,2,4] [--spins 0,100]\n"
+        "       %*s [--idle-spins 0,2048]\n"
+        "       %s --generate N [--seed S] [--binary]\n", prog, static_cast<int>(std::strlen(prog)), "", prog);
+    std::exit(EXIT_FAILURE);
+}
+
+} // namespace
+
+
+/**
+ * @brief Entry point function
+ *
+ * @param argc Number of arguments
+ * @param argv Arguments passed to the program
+ * @return Result of program operation
+ */
+int main(int argc, char* argv[]) {
+    bool json = false;
+    std::string only;
+    std::size_t jobs = 200000;
+    std::size_t generate_n = 0;
+    unsigned seed = 1;
+    bool binary = false;
+    std::vector<unsigned> threads;
+    std::vector<unsigned> spins = {0, 100, 1000};
+    // parking right away vs the default idle policy
+    std::vector<unsigned> idle_spins = {0, IdlePolicy{}.spins};
+
+    for (int i = 1; i < argc; ++i) {
+        auto opt = [&](const char* name) { return !std::strcmp(argv[i], name) && i + 1 < argc; };
+        if (opt("--format")) {
+            json = !std::strcmp(argv[++i], "json");
+        } else if (opt("--only")) {
+            only = argv[++i];
+        } else if (opt("--jobs")) {
+            jobs = std::strtoul(argv[++i], nullptr, 10);
+        } else if (opt("--threads")) {
+            threads = parse_list(argv[++i]);
+        } else if (opt("--spins")) {
+            spins = parse_list(argv[++i]);
+        } else if (opt("--idle-spins")) {
+            idle_spins = parse_list(argv[++i]);
+        } else if (opt("--generate")) {
+            generate_n = std::strtoul(argv[++i], nullptr, 10);
+        } else if (opt("--seed")) {
+            seed = std::strtoul(argv[++i], nullptr, 10);
+        } else if (!std::strcmp(argv[i], "--binary")) {
+            binary = true;
+        } else {
+            usage(argv[0]);
+        }
+    }
+
+    if (generate_n) {
+        if (binary) {
+            generate_binary(generate_n, seed);
+        } else {
+            generate(generate_n, seed);
+        }
+        return 0;
+    }
+
+    if (threads.empty()) {
+        for (unsigned t = 1; t < WorkerPool::nthreads; t *= 2) { threads.push_back(t); }
+        threads.push_back(std::max(1u, WorkerPool::nthreads));
+    }
+
+    Report report(json);
+
+    if (only.empty() || only == "pool") {
+        for (auto sched : {Scheduling::fifo, Scheduling::work_stealing, Scheduling::lock_free}) {
+            for (auto comp : {Completion::futures, Completion::ring, Completion::batched, Completion::unordered}) {
+                for (auto t : threads) {
+                    for (auto idle : idle_spins) {
+                        for (auto s : spins) {
+                            WorkerPoolOptions options;
+                            options.scheduling = sched;
+                            options.completion = comp;
+                            options.idle.spins = idle;
+                            options.idle.yields = idle ? options.idle.yields : 0;
+                            options.verbose = false;
+                            bench_pool({t, options, s, jobs}, report);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    if (only.empty() || only == "layout") {
+        for (auto t : threads) { bench_layout(t, jobs, report); }
+    }
+
+    if (only.empty() || only == "solver") {
+        for (const char* kind : {"valid", "invalid", "overflow"}) {
+            bench_solver(kind, 200000, report);
+        }
+    }
+
+    report.print();
+    return 0;
+}
@@ -0,0 +1,54 @@
+/**
+ * @file binary_format.cpp
+ * @author Albert Kharisov <albkharisov@gmail.com>
+ * @version 1.0
+ *
+ * @brief Packed binary records of the equations and the answers.
+ */
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include "binary_format.hpp"
+
+
+namespace {
+
+/** Equations solved at once, coefficients of them fit on the stack */
+constexpr std::size_t binary_batch = 256;
+
+} // namespace
+
+
+BinaryAnswer pack_roots(const Roots& roots) noexcept {
+    BinaryAnswer answer{};
+    answer.kind = static_cast<std::uint8_t>(roots.kind);
+    if (roots.kind == RootsKind::one || roots.kind == RootsKind::two) { answer.x1 = roots.x1; }
+    if (roots.kind == RootsKind::two) { answer.x2 = roots.x2; }
+    if (roots.has_extremum) {
+        answer.has_extremum = 1;
+        answer.minimum = roots.minimum;
+        answer.extremum = roots.extremum;
+    }
+    return answer;
+}
+
+void solve_binary(const char* equations, std::size_t n, char* answers) noexcept {
+    std::array<int, binary_batch> a, b, c;
+    std::array<Roots, binary_batch> roots;
+    for (std::size_t done = 0; done < n; done += binary_batch) {
+        const auto count = std::min(binary_batch, n - done);
+        for (std::size_t i = 0; i < count; ++i) {
+            BinaryEquation e;
+            std::memcpy(&e, equations + (done + i) * sizeof(e), sizeof(e));
+            a[i] = e.a;
+            b[i] = e.b;
+            c[i] = e.c;
+        }
+        solve_square_equations(a.data(), b.data(), c.data(), count, roots.data());
+        for (std::size_t i = 0; i < count; ++i) {
+            const auto answer = pack_roots(roots[i]);
+            std::memcpy(answers + (done + i) * sizeof(answer), &answer, sizeof(answer));
+        }
+    }
+}
@@ -0,0 +1,73 @@
+/**
+ * @file binary_format.hpp
+ * @author Albert Kharisov <albkharisov@gmail.com>
+ * @version 1.0
+ *
+ * @brief Packed binary records of the equations and the answers.
+ *
+ * Records are fixed size, in the byte order of the host and without
+ * any header, so a file of them can be mapped and split anywhere
+ * at a record boundary. Meant for services on the same architecture,
+ * text stays the default format.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "square_solver.hpp"
+
+/**
+ * @brief Coefficients of one equation.
+ */
+struct BinaryEquation {
+    /** Parameter a */
+    std::int32_t a;
+    /** Parameter b */
+    std::int32_t b;
+    /** Parameter c */
+    std::int32_t c;
+};
+
+static_assert(sizeof(BinaryEquation) == 12, "BinaryEquation has to be packed");
+
+/**
+ * @brief Answer to one equation.
+ *
+ * Doubles not used by `kind` and `has_extremum` are zero.
+ */
+struct BinaryAnswer {
+    /** RootsKind of the solution */
+    std::uint8_t kind;
+    /** 1 if the equation has an extremum */
+    std::uint8_t has_extremum;
+    /** 1 if the extremum is minimum */
+    std::uint8_t minimum;
+    /** Zero */
+    std::uint8_t reserved[5];
+    /** First root */
+    double x1;
+    /** Second root */
+    double x2;
+    /** X of the extremum */
+    double extremum;
+};
+
+static_assert(sizeof(BinaryAnswer) == 32, "BinaryAnswer has to be packed");
+
+/**
+ * @brief Pack the solution.
+ */
+BinaryAnswer pack_roots(const Roots& roots) noexcept;
+
+/**
+ * @brief Solve packed equations into packed answers.
+ *
+ * Equations are solved in batches with `solve_square_equations()`,
+ * records don't need to be aligned.
+ *
+ * @param equations n records of BinaryEquation
+ * @param n number of equations
+ * @param answers where to write n records of BinaryAnswer
+ */
+void solve_binary(const char* equations, std::size_t n, char* answers) noexcept;
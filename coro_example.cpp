@@ -0,0 +1,106 @@
+/**
+ * @file coro_example.cpp
+ * @author Albert Kharisov <albkharisov@gmail.com>
+ * @version 1.0
+ *
+ * @brief Example of the coroutine front-end of the worker pool.
+ *
+ * Runs a coroutine through `schedule()` and `submit()` with a value,
+ * with a throwing job and with a cancelled job, waiting for it with
+ * `sync_wait()`. Built as C++20, so worker_pool_coro.hpp is compiled
+ * against the current pool, and run by ctest: exits with failure if
+ * any of the results is not the expected one.
+ */
+
+#include <cstdlib>
+#include <future>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+#include "worker_pool_coro.hpp"
+
+namespace {
+
+/** Number of failed checks */
+int failures = 0;
+
+/** Account the check, printing it */
+void check(bool ok, const char* what) {
+    std::cout << (ok ? "ok     " : "FAILED ") << what << std::endl;
+    if (!ok) { ++failures; }
+}
+
+/** Move to a worker, then double the value on a job, -1 if the coroutine stays on the caller */
+Coro<int> twice(CoroPool& pool, int x, std::thread::id caller) {
+    co_await pool.schedule();
+    if (std::this_thread::get_id() == caller) { co_return -1; }
+    co_return co_await pool.submit([](int a) { return a * 2; }, x);
+}
+
+/** Await a job throwing, the exception comes out of `co_await` */
+Coro<bool> throwing(CoroPool& pool) {
+    try {
+        co_await pool.submit([] { throw std::runtime_error("job failed"); });
+    } catch (const std::runtime_error&) {
+        co_return true;
+    }
+    co_return false;
+}
+
+/** Await the worker, report if the pool cancelled the resumption */
+Coro<bool> cancelled(CoroPool& pool) {
+    try {
+        co_await pool.schedule();
+    } catch (const JobCancelled&) {
+        co_return true;
+    }
+    co_return false;
+}
+
+/** Coroutine returning nothing, awaiting another one */
+Coro<> nested(CoroPool& pool, int& out) {
+    out = co_await twice(pool, 5, std::thread::id());
+}
+
+} // namespace
+
+
+/**
+ * @brief Entry point function
+ *
+ * @return EXIT_SUCCESS if all the checks passed
+ */
+int main() {
+    WorkerPoolOptions options;
+    options.verbose = false;
+    WorkerPool workers(2, options);
+    CoroPool pool(workers);
+
+    check(sync_wait(twice(pool, 20, std::this_thread::get_id())) == 40, "schedule() and submit() with a value");
+    check(sync_wait(throwing(pool)), "submit() of a throwing job rethrows in the coroutine");
+
+    int out = 0;
+    sync_wait(nested(pool, out));
+    check(out == 10, "nested coroutines");
+
+    {
+        // the only worker is busy, so the resumption stays queued until cancelled
+        std::promise<void> release;
+        std::promise<void> started;
+        WorkerPool single(1, options);
+        CoroPool busy(single);
+        single.post([&release, &started] {
+            started.set_value();
+            release.get_future().wait();
+        });
+        started.get_future().wait();
+
+        auto waiter = std::async(std::launch::async, [&busy] { return sync_wait(cancelled(busy)); });
+        // the coroutine is queued once the pool has a pending job
+        while (single.cancel() == 0) { std::this_thread::yield(); }
+        check(waiter.get(), "cancel() resumes the coroutine with JobCancelled");
+        release.set_value();
+    }
+
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
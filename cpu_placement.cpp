@@ -0,0 +1,150 @@
+/**
+ * @file cpu_placement.cpp
+ * @author Albert Kharisov <albkharisov@gmail.com>
+ * @version 1.0
+ *
+ * @brief Placement of threads on CPUs and NUMA nodes.
+ */
+
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <string>
+#include <tuple>
+#include "cpu_placement.hpp"
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+
+namespace {
+
+#ifdef __linux__
+
+/** Read a number from a sysfs file, 0 if there is none */
+unsigned read_number(const std::string& path) {
+    std::ifstream in(path);
+    unsigned value = 0;
+    in >> value;
+    return in ? value : 0;
+}
+
+/**
+ * Parse sysfs CPU list like "0-3,8,10-11".
+ *
+ * @return listed CPUs, empty if the file is missing
+ */
+std::vector<unsigned> read_cpu_list(const std::string& path) {
+    std::ifstream in(path);
+    std::vector<unsigned> cpus;
+    unsigned first;
+    while (in >> first) {
+        unsigned last = first;
+        if (in.peek() == '-') {
+            in.get();
+            in >> last;
+        }
+        for (unsigned cpu = first; cpu <= last; ++cpu) { cpus.push_back(cpu); }
+        if (in.peek() == ',') { in.get(); }
+    }
+    return cpus;
+}
+
+#endif // __linux__
+
+} // namespace
+
+
+std::vector<CpuInfo> cpu_topology() {
+    std::vector<CpuInfo> cpus;
+#ifdef __linux__
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) { return cpus; }
+
+    // node directories may be sparse, the list of nodes isn't
+    std::map<unsigned, unsigned> node_of;
+    for (unsigned node : read_cpu_list("/sys/devices/system/node/online")) {
+        for (unsigned cpu : read_cpu_list("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist")) {
+            node_of[cpu] = node;
+        }
+    }
+
+    for (unsigned cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (!CPU_ISSET(cpu, &allowed)) { continue; }
+        const std::string topology = "/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/topology/";
+        const auto node = node_of.find(cpu);
+        cpus.push_back({cpu, node == node_of.end() ? 0 : node->second,
+                        read_number(topology + "physical_package_id"),
+                        read_number(topology + "core_id")});
+    }
+#endif
+    return cpus;
+}
+
+std::vector<CpuSlot> placement_slots(Placement placement, const std::vector<CpuInfo>& cpus) {
+    std::vector<CpuSlot> slots;
+    if (placement == Placement::none || cpus.empty()) { return slots; }
+
+    auto sorted = cpus;
+    std::sort(sorted.begin(), sorted.end(), [](const CpuInfo& l, const CpuInfo& r) {
+        return std::tie(l.node, l.package, l.core, l.cpu) < std::tie(r.node, r.package, r.core, r.cpu);
+    });
+
+    if (placement == Placement::compact) {
+        for (const auto& info : sorted) { slots.push_back({{info.cpu}, info.node}); }
+        return slots;
+    }
+
+    if (placement == Placement::numa) {
+        for (const auto& info : sorted) {
+            if (slots.empty() || slots.back().node != info.node) { slots.push_back({{}, info.node}); }
+            slots.back().cpus.push_back(info.cpu);
+        }
+        return slots;
+    }
+
+    // Placement::spread: every physical core before its hyperthreads,
+    // and the nodes take turns for each rank
+    struct Ranked {
+        unsigned sibling;
+        unsigned core;
+        const CpuInfo* info;
+    };
+    std::vector<Ranked> ranked;
+    for (std::size_t i = 0; i < sorted.size(); ++i) {
+        const auto& info = sorted[i];
+        const bool same_node = i && sorted[i - 1].node == info.node;
+        const bool same_core = same_node && sorted[i - 1].package == info.package &&
+                               sorted[i - 1].core == info.core;
+        Ranked r{0, 0, &info};
+        if (same_core) {
+            r = {ranked.back().sibling + 1, ranked.back().core, &info};
+        } else if (same_node) {
+            r = {0, ranked.back().core + 1, &info};
+        }
+        ranked.push_back(r);
+    }
+    std::stable_sort(ranked.begin(), ranked.end(), [](const Ranked& l, const Ranked& r) {
+        return std::tie(l.sibling, l.core) < std::tie(r.sibling, r.core);
+    });
+    for (const auto& r : ranked) { slots.push_back({{r.info->cpu}, r.info->node}); }
+    return slots;
+}
+
+bool pin_current_thread(const CpuSlot& slot) noexcept {
+#ifdef __linux__
+    if (slot.cpus.empty()) { return false; }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (unsigned cpu : slot.cpus) {
+        if (cpu < CPU_SETSIZE) { CPU_SET(cpu, &set); }
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    (void)slot;
+    return false;
+#endif
+}
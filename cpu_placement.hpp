@@ -0,0 +1,81 @@
+/**
+ * @file cpu_placement.hpp
+ * @author Albert Kharisov <albkharisov@gmail.com>
+ * @version 1.0
+ *
+ * @brief Placement of threads on CPUs and NUMA nodes.
+ */
+
+#pragma once
+
+#include <vector>
+
+/**
+ * @brief Policy of pinning threads to CPUs.
+ */
+enum class Placement {
+    /** Threads are not pinned, the OS scheduler decides */
+    none,
+    /** Each thread is pinned to one CPU, filling a core, then a node, then the next one */
+    compact,
+    /** Each thread is pinned to one CPU, taking a core from every node in turn */
+    spread,
+    /** Each thread is pinned to all CPUs of one node, taking the nodes in turn */
+    numa,
+};
+
+/**
+ * @brief Where one thread is allowed to run.
+ */
+struct CpuSlot {
+    /** CPUs the thread is pinned to */
+    std::vector<unsigned> cpus;
+    /** NUMA node of these CPUs */
+    unsigned node;
+};
+
+/**
+ * @brief Logical CPU and its place in the topology.
+ */
+struct CpuInfo {
+    /** Logical CPU number */
+    unsigned cpu;
+    /** NUMA node */
+    unsigned node;
+    /** Physical package (socket) */
+    unsigned package;
+    /** Core id within the package */
+    unsigned core;
+};
+
+/**
+ * @brief CPUs the process is allowed to run on.
+ *
+ * Topology is read from sysfs. Anything unknown is reported as 0,
+ * so a machine without NUMA is a single node.
+ *
+ * @return allowed CPUs, empty if not supported on this platform
+ */
+std::vector<CpuInfo> cpu_topology();
+
+/**
+ * @brief Slots for the threads in the order of the placement.
+ *
+ * Thread `i` goes to slot `i % size()`. The order is fixed, so threads
+ * placed with an offset don't collide with the ones placed before them.
+ *
+ * @param placement placement policy
+ * @param cpus allowed CPUs, see `cpu_topology()`
+ * @return slots, empty for Placement::none or unknown topology
+ */
+std::vector<CpuSlot> placement_slots(Placement placement, const std::vector<CpuInfo>& cpus = cpu_topology());
+
+/**
+ * @brief Pin the calling thread to the CPUs of the slot.
+ *
+ * Placement is a hint: restricted or unsupported systems leave
+ * the thread where it was.
+ *
+ * @return true if the thread is pinned
+ */
+bool pin_current_thread(const CpuSlot& slot) noexcept;
@@ -0,0 +1,175 @@
+/**
+ * @file input_reader.cpp
+ * @author Albert Kharisov <albkharisov@gmail.com>
+ * @version 1.0
+ *
+ * @brief Block input reader splitting whitespace separated records in place.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <system_error>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "input_reader.hpp"
+
+
+/** Same set of separators as `std::cin >>` uses in C locale */
+static bool is_space(char c) {
+    return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+InputBlock::InputBlock(std::size_t size)
+        : bytes(new char[size]),
+          allocated(size) {}
+
+InputBlock::InputBlock(char* addr, std::size_t size)
+        : bytes(addr),
+          used(size),
+          allocated(size),
+          mapped(true) {}
+
+InputBlock::~InputBlock() {
+    if (mapped) {
+        munmap(bytes, allocated);
+    } else {
+        delete[] bytes;
+    }
+}
+
+InputBlockPtr map_input(int fd) {
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0) { return nullptr; }
+
+    auto length = static_cast<std::size_t>(st.st_size);
+    void* addr = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (addr == MAP_FAILED) { return nullptr; }
+    madvise(addr, length, MADV_SEQUENTIAL);
+    return std::make_shared<InputBlock>(static_cast<char*>(addr), length);
+}
+
+std::vector<std::size_t> split_shards(const InputBlock& block, std::size_t n) {
+    n = std::max<std::size_t>(n, 1);
+    const auto size = block.size();
+    std::vector<std::size_t> bounds(n + 1, size);
+    bounds[0] = 0;
+    for (std::size_t i = 1; i < n; ++i) {
+        // about the even split, moved forward to the next whitespace
+        auto p = std::max(bounds[i - 1], size / n * i);
+        while (p < size && !is_space(block.data()[p])) { ++p; }
+        bounds[i] = p;
+    }
+    return bounds;
+}
+
+std::size_t count_fields(const InputBlock& block, std::size_t begin, std::size_t end) {
+    const char* bytes = block.data();
+    std::size_t fields = 0;
+    // a boundary is whitespace, so a field before it doesn't count
+    bool space = true;
+    for (auto p = begin; p < end; ++p) {
+        const bool s = is_space(bytes[p]);
+        fields += space && !s;
+        space = s;
+    }
+    return fields;
+}
+
+InputReader::InputReader(int input_fd, std::size_t size)
+        : fd(input_fd),
+          block_size(size ? size : 1) {
+    if (auto mapped = map_input(fd)) {
+        // mapped blocks are never refilled, so never written
+        block = std::const_pointer_cast<InputBlock>(mapped);
+        eof = true;
+        return;
+    }
+    block = std::make_shared<InputBlock>(0);
+}
+
+InputReader::InputReader(InputBlockPtr mapped, std::size_t begin, std::size_t end)
+        : fd(-1),
+          block_size(1),
+          block(std::const_pointer_cast<InputBlock>(mapped)),
+          pos(begin),
+          limit(end),
+          eof(true) {}
+
+void InputReader::skip(std::size_t n) {
+    std::array<std::string_view, 2> fields;
+    if (n > 0) { next(fields.data(), std::min(n, fields.size())); }
+}
+
+bool InputReader::refill(std::size_t record_start) {
+    if (eof) { return false; }
+
+    // keep at least a half of the block for the new data
+    const auto tail = block->used - record_start;
+    auto size = block_size;
+    while (size < tail + block_size / 2 + 1) { size *= 2; }
+
+    auto fresh = std::make_shared<InputBlock>(size);
+    std::memcpy(fresh->bytes, block->bytes + record_start, tail);
+    fresh->used = tail;
+
+    ssize_t n;
+    do {
+        n = read(fd, fresh->bytes + fresh->used, fresh->allocated - fresh->used);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0) {
+        throw std::system_error(errno, std::generic_category(), "input read failed");
+    }
+    if (n == 0) {
+        eof = true;
+    }
+    fresh->used += static_cast<std::size_t>(n);
+
+    block = std::move(fresh);
+    pos = 0;
+    return true;
+}
+
+bool InputReader::next(std::string_view* fields, std::size_t n) {
+    for (;;) {
+        const char* bytes = block->bytes;
+        const auto used = block->used;
+        auto p = pos;
+        std::size_t i = 0;
+
+        for (; i < n; ++i) {
+            while (p < used && is_space(bytes[p])) { ++p; }
+            if (p == used) { break; }
+            // the record belongs to the next shard
+            if (i == 0 && p >= limit) { return false; }
+
+            const auto start = p;
+            while (p < used && !is_space(bytes[p])) { ++p; }
+            // the field may continue in the next block
+            if (p == used && !eof) { break; }
+            fields[i] = {bytes + start, p - start};
+        }
+
+        if (i == n) {
+            pos = p;
+            return true;
+        }
+        if (!refill(pos)) { return false; }
+    }
+}
+
+const char* InputReader::next_record(std::size_t size) {
+    for (;;) {
+        // the record belongs to the next shard
+        if (pos >= limit) { return nullptr; }
+        if (block->used - pos >= size) {
+            const char* record = block->bytes + pos;
+            pos += size;
+            return record;
+        }
+        if (!refill(pos)) { return nullptr; }
+    }
+}
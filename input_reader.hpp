@@ -0,0 +1,193 @@
+/**
+ * @file input_reader.hpp
+ * @author Albert Kharisov <albkharisov@gmail.com>
+ * @version 1.0
+ *
+ * @brief Block input reader splitting whitespace separated records in place.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <limits>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+/**
+ * @brief Bytes of the input.
+ *
+ * Either a heap buffer filled with read(2) or the whole
+ * regular file mmap-ed. Views of the fields point into it,
+ * so it's shared by everybody holding these views.
+ */
+class InputBlock {
+    /** Beginning of the bytes */
+    char* bytes = nullptr;
+    /** Number of valid bytes */
+    std::size_t used = 0;
+    /** Size of allocated or mapped memory */
+    std::size_t allocated = 0;
+    /** Memory is mapped, not allocated */
+    bool mapped = false;
+
+    friend class InputReader;
+
+public:
+    /**
+     * A constructor. Allocates the buffer.
+     *
+     * @param size capacity of the buffer
+     */
+    explicit InputBlock(std::size_t size);
+
+    /**
+     * A constructor. Takes ownership of the mapped memory.
+     *
+     * @param addr mapped memory
+     * @param size size of the mapping
+     */
+    InputBlock(char* addr, std::size_t size);
+
+    /** A destructor. Releases the memory */
+    ~InputBlock();
+
+    /** Forbid this. Views point into the block */
+    InputBlock(const InputBlock&) = delete;
+    /** Forbid this. Views point into the block */
+    InputBlock& operator=(const InputBlock&) = delete;
+
+    /** Get the bytes */
+    const char* data() const { return bytes; }
+    /** Get number of valid bytes */
+    std::size_t size() const { return used; }
+};
+
+/** Shared ownership of the input block */
+using InputBlockPtr = std::shared_ptr<const InputBlock>;
+
+/**
+ * @brief Map the whole regular file.
+ *
+ * @param fd file descriptor of the file
+ * @return the mapped file, null if it's not a regular file or can't be mapped
+ */
+InputBlockPtr map_input(int fd);
+
+/**
+ * @brief Split the block into shards at whitespace.
+ *
+ * Shards are about the same size, every boundary but the last is
+ * a whitespace byte, so no field starts in one shard and ends in another.
+ * Shards of a short block may be empty.
+ *
+ * @param block the input
+ * @param n number of shards
+ * @return n+1 boundaries, shard i is [bounds[i], bounds[i+1])
+ */
+std::vector<std::size_t> split_shards(const InputBlock& block, std::size_t n);
+
+/**
+ * @brief Count the fields starting in [begin, end) of the block.
+ *
+ * @param begin a boundary from `split_shards()`
+ * @param end the next boundary
+ */
+std::size_t count_fields(const InputBlock& block, std::size_t begin, std::size_t end);
+
+/**
+ * @brief Reader of whitespace separated records.
+ *
+ * Reads the input in large blocks (or maps it, if it's a regular file)
+ * and splits it into fields without copying them: fields are views
+ * into the current block. Records are never split between blocks,
+ * so a record needs to hold only one block alive.
+ *
+ * A reader of a shard of the mapped file takes the records starting in
+ * the shard, the last one may continue past its end.
+ *
+ * Trailing incomplete record is dropped.
+ */
+class InputReader {
+    /** File descriptor to read from */
+    const int fd;
+    /** Size of the blocks to read */
+    std::size_t block_size;
+    /** Current block */
+    std::shared_ptr<InputBlock> block;
+    /** Position of the next field to parse in the current block */
+    std::size_t pos = 0;
+    /** End of the shard, no record starts at or past it */
+    std::size_t limit = std::numeric_limits<std::size_t>::max();
+    /** No more data from fd */
+    bool eof = false;
+
+    /**
+     * Read the next block keeping the bytes of the current record.
+     * Block is grown if the record doesn't fit in it.
+     *
+     * @param record_start position where the current record starts
+     * @return false if there is nothing more to read
+     */
+    bool refill(std::size_t record_start);
+
+public:
+    /**
+     * A constructor.
+     *
+     * Regular files are mapped, anything else is read block by block.
+     *
+     * @param input_fd file descriptor to read from
+     * @param size size of the blocks to read
+     */
+    explicit InputReader(int input_fd, std::size_t size = 1 << 20);
+
+    /**
+     * A constructor. Reads a shard of the mapped file.
+     *
+     * @param mapped the file, see `map_input()`
+     * @param begin first byte of the shard, see `split_shards()`
+     * @param end end of the shard
+     */
+    InputReader(InputBlockPtr mapped, std::size_t begin, std::size_t end);
+
+    /**
+     * Skip the fields of a record started before the shard.
+     *
+     * @param n number of fields, less than a record has
+     */
+    void skip(std::size_t n);
+
+    /**
+     * Get fields of the next record.
+     * Views stay valid while the block from `current()` is held.
+     *
+     * @param fields where to put views of the fields
+     * @param n number of fields in the record
+     * @return false at the end of input
+     */
+    bool next(std::string_view* fields, std::size_t n);
+
+    /**
+     * Get fields of the next record.
+     *
+     * @param fields where to put views of the fields
+     * @return false at the end of input
+     */
+    template <std::size_t N>
+    bool next(std::array<std::string_view, N>& fields) { return next(fields.data(), N); }
+
+    /**
+     * Get the next fixed size binary record instead of the fields.
+     * The bytes stay valid while the block from `current()` is held,
+     * records following each other in one block are contiguous.
+     *
+     * @param size size of the record
+     * @return the bytes, null at the end of input
+     */
+    const char* next_record(std::size_t size);
+
+    /** Block holding the fields of the last record */
+    InputBlockPtr current() const { return block; }
+};
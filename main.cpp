@@ -11,11 +11,400 @@
  */
 
 #include <thread>
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <optional>
 #include <string>
+#include <string_view>
+#include <system_error>
+#include <tuple>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include "answer_cache.hpp"
+#include "binary_format.hpp"
+#include "cpu_placement.hpp"
+#include "input_reader.hpp"
+#include "output_writer.hpp"
+#include "parallel_algorithms.hpp"
+#include "pool_trace.hpp"
+#include "solver_pipeline.hpp"
 #include "worker_pool.hpp"
 #include "square_solver.hpp"
 
+/**
+ * @brief Command line options of the program
+ */
+struct Options {
+    /** Number of equations sent to the worker pool at once */
+    std::size_t chunk_size = 64;
+    /** Maximum time an answer waits in the output buffer */
+    std::chrono::milliseconds flush_interval{10};
+    /** Pinning of the reader, the printer and the workers */
+    Placement placement = Placement::none;
+    /** Print the worker pool counters to stderr at exit */
+    bool print_stats = false;
+    /** Print answers as soon as they are ready, not in the input order */
+    bool unordered = false;
+    /** Start with one worker and let the pool grow and shrink with the load */
+    bool autoscale = false;
+    /** Solve every chunk with `parallel_transform()`, the reader thread helps the workers */
+    bool transform = false;
+    /** Solve chunks in stages, see SolverPipeline. Empty to solve every equation as a job */
+    StageGroups pipeline;
+    /** Most answers kept in AnswerCache, 0 to solve every equation */
+    std::size_t cache_size = 0;
+    /** Input files in order, "-" is the standard input. Empty to read the standard input */
+    std::vector<const char*> inputs;
+    /** Number of readers every regular input file is split between */
+    std::size_t shards = 1;
+    /** Read BinaryEquation records and write BinaryAnswer records instead of text */
+    bool binary = false;
+    /** File the Chrome trace of the jobs is written to, empty not to trace */
+    std::string trace;
+};
+
+/**
+ * @brief Parse command line arguments.
+ *
+ * Supported options:
+ *  --chunk N     number of equations sent to the worker pool at once.
+ *                Use 1 for interactive input.
+ *  --flush-ms N  maximum time in ms an answer waits in the output buffer,
+ *                0 to write only full buffers.
+ *  --placement P pin threads to CPUs: none, compact, spread or numa.
+ *  --stats       print the worker pool counters to stderr at exit.
+ *  --unordered   print answers as soon as they are ready. Every answer
+ *                echoes its coefficients, so the input order isn't needed.
+ *  --autoscale   start with one worker, grow and shrink with the load.
+ *  --transform   solve every chunk with parallel_transform, the main thread
+ *                solves too and prints the chunk. Use a large --chunk.
+ *  --pipeline S  solve every chunk in stages: parse, solve, format.
+ *                Commas separate jobs, pluses fuse stages into one job,
+ *                e.g. "parse+solve,format". Use a large --chunk.
+ *  --cache N     keep the answers to up to N distinct equations and
+ *                don't solve them again, 0 (default) to solve every one.
+ *  --shards N    split every regular input file between N readers.
+ *  --binary      read packed BinaryEquation records and write packed
+ *                BinaryAnswer records in the input order. Can't be used
+ *                with --unordered, --transform, --pipeline and --cache.
+ *  --trace F     record when every job is queued, run and its answer
+ *                taken, write it to F as Chrome trace JSON at exit
+ *                and on SIGUSR1.
+ *
+ * Other arguments are input files, read in parallel and answered in
+ * their order. Every file is a separate input: a record doesn't continue
+ * into the next file. Without them the standard input is read.
+ *
+ * @param argc Number of arguments
+ * @param argv Arguments passed to the program
+ * @return parsed options, exits on invalid arguments
+ */
+static Options parse_options(int argc, char* argv[]) {
+    auto usage = [argv] {
+        std::cerr << "usage: " << argv[0] << " [--chunk N] [--flush-ms N]"
+                  << " [--placement none|compact|spread|numa] [--stats] [--unordered] [--autoscale] [--transform]"
+                  << " [--pipeline parse,solve,format] [--cache N] [--shards N] [--binary] [--trace file] [file...]" << std::endl;
+        std::exit(EXIT_FAILURE);
+    };
+
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        if (!std::strcmp(argv[i], "--chunk") && i + 1 < argc) {
+            options.chunk_size = std::strtoul(argv[++i], nullptr, 10);
+            if (options.chunk_size == 0) { options.chunk_size = 1; }
+        } else if (!std::strcmp(argv[i], "--flush-ms") && i + 1 < argc) {
+            options.flush_interval = std::chrono::milliseconds(std::strtoul(argv[++i], nullptr, 10));
+        } else if (!std::strcmp(argv[i], "--autoscale")) {
+            options.autoscale = true;
+        } else if (!std::strcmp(argv[i], "--pipeline") && i + 1 < argc) {
+            options.pipeline = parse_stage_groups(argv[++i]);
+            if (options.pipeline.empty()) { usage(); }
+        } else if (!std::strcmp(argv[i], "--cache") && i + 1 < argc) {
+            options.cache_size = std::strtoul(argv[++i], nullptr, 10);
+        } else if (!std::strcmp(argv[i], "--shards") && i + 1 < argc) {
+            options.shards = std::max<std::size_t>(1, std::strtoul(argv[++i], nullptr, 10));
+        } else if (!std::strcmp(argv[i], "--trace") && i + 1 < argc) {
+            options.trace = argv[++i];
+        } else if (!std::strcmp(argv[i], "--binary")) {
+            options.binary = true;
+        } else if (!std::strcmp(argv[i], "--transform")) {
+            options.transform = true;
+        } else if (!std::strcmp(argv[i], "--unordered")) {
+            options.unordered = true;
+        } else if (!std::strcmp(argv[i], "--stats")) {
+            options.print_stats = true;
+        } else if (!std::strcmp(argv[i], "--placement") && i + 1 < argc) {
+            const std::string_view name = argv[++i];
+            if (name == "compact") {
+                options.placement = Placement::compact;
+            } else if (name == "spread") {
+                options.placement = Placement::spread;
+            } else if (name == "numa") {
+                options.placement = Placement::numa;
+            } else if (name != "none") {
+                usage();
+            }
+        } else if (argv[i][0] != '-' || !std::strcmp(argv[i], "-")) {
+            options.inputs.push_back(argv[i]);
+        } else {
+            usage();
+        }
+    }
+    // packed answers don't echo the coefficients and aren't text
+    if (options.binary && (options.unordered || options.transform || !options.pipeline.empty()
+                           || options.cache_size)) {
+        usage();
+    }
+    return options;
+}
+
+/**
+ * Coefficients are views into the input block,
+ * the job holds the block until it's done.
+ */
+using Equation = std::tuple<InputBlockPtr, std::string_view, std::string_view, std::string_view>;
+
+/** Smallest number of equations solved at once by `parallel_transform()` */
+static constexpr std::size_t transform_grain = 16;
+
+/**
+ * @brief Job solving one equation.
+ *
+ * Answer is written into a buffer recycled by the printer.
+ * Only running out of memory may fail it, so it's noexcept
+ * and the pool doesn't catch anything around it.
+ */
+struct Solve {
+    /** Answers already solved, null to solve every equation */
+    AnswerCache* cache = nullptr;
+
+    /** Solve the equation with the coefficients */
+    WorkerPool::Answer operator()(const InputBlockPtr&, std::string_view a,
+                                  std::string_view b, std::string_view c) const noexcept {
+        auto answer = WorkerPool::answer_buffer();
+        answer.resize(answer_size(a, b, c));
+        answer.resize(cache ? cache->write_answer(a, b, c, answer.data())
+                            : write_square_roots(a, b, c, answer.data(), answer.size()).size);
+        return answer;
+    }
+
+    /** Solve the equation of the chunk */
+    WorkerPool::Answer operator()(const Equation& e) const noexcept { return std::apply(*this, e); }
+};
+
+/**
+ * @brief Packed equations following each other in one input block.
+ */
+struct BinaryChunk {
+    /** Block holding the records */
+    InputBlockPtr block;
+    /** First record */
+    const char* records = nullptr;
+    /** Number of records */
+    std::size_t count = 0;
+
+    /** The record is the next one in the same block */
+    bool continued_by(const char* record) const {
+        return record == records + count * sizeof(BinaryEquation)
+               && record < block->data() + block->size();
+    }
+};
+
+/**
+ * @brief Job solving a chunk of packed equations into packed answers.
+ */
+struct SolveBinary {
+    /** Solve the equations of the chunk */
+    WorkerPool::Answer operator()(const BinaryChunk& chunk) const noexcept {
+        auto answer = WorkerPool::answer_buffer();
+        answer.resize(chunk.count * sizeof(BinaryAnswer));
+        solve_binary(chunk.records, chunk.count, answer.data());
+        return answer;
+    }
+};
+
+/**
+ * @brief Part of the input read by its own reader.
+ */
+struct InputShard {
+    /** The mapped file, null to read `fd` as a stream */
+    InputBlockPtr block;
+    /** File descriptor read if the file isn't mapped */
+    int fd = -1;
+    /** First byte of the shard in the mapped file */
+    std::size_t begin = 0;
+    /** End of the shard, records starting past it belong to the next one */
+    std::size_t end = 0;
+    /** Fields of the record started before the shard */
+    std::size_t skip = 0;
+    /** First shard of its file */
+    bool first = true;
+
+    /** Reader of the records of the shard */
+    InputReader reader() const {
+        if (!block) { return InputReader(fd); }
+        InputReader reader(block, begin, end);
+        reader.skip(skip);
+        return reader;
+    }
+};
+
+/**
+ * @brief Chunks read from one shard, waiting for their turn.
+ *
+ * Bounded, so a reader getting ahead of the shards before it
+ * waits instead of holding its whole shard in chunks.
+ */
+template <typename Chunk>
+class ChunkQueue {
+    /** Protects everything below */
+    std::mutex m;
+    /** Signals a change for the only reader or the only consumer */
+    std::condition_variable cv;
+    /** The chunks */
+    std::deque<Chunk> chunks;
+    /** The reader is done */
+    bool closed = false;
+
+public:
+    /** Most chunks waiting */
+    static constexpr std::size_t capacity = 64;
+
+    /** Add the chunk, wait while the queue is full */
+    void push(Chunk chunk) {
+        std::unique_lock<std::mutex> l(m);
+        cv.wait(l, [this] { return chunks.size() < capacity; });
+        chunks.push_back(std::move(chunk));
+        cv.notify_one();
+    }
+
+    /** No chunks will be added */
+    void close() {
+        std::lock_guard<std::mutex> l(m);
+        closed = true;
+        cv.notify_one();
+    }
+
+    /**
+     * Take the next chunk, wait for it.
+     *
+     * @return false when the queue is closed and empty
+     */
+    bool pop(Chunk& chunk) {
+        std::unique_lock<std::mutex> l(m);
+        cv.wait(l, [this] { return !chunks.empty() || closed; });
+        if (chunks.empty()) { return false; }
+        chunk = std::move(chunks.front());
+        chunks.pop_front();
+        cv.notify_one();
+        return true;
+    }
+};
+
+/**
+ * @brief Open the input files and split them into shards.
+ *
+ * Regular files are mapped and split at whitespace (or at records
+ * with --binary), anything else is a single shard read as a stream.
+ * Fields of a record started in the shard before are counted on
+ * the worker pool.
+ *
+ * @throw std::system_error if a file can't be opened
+ */
+static std::vector<InputShard> open_shards(const Options& options, WorkerPool& pool) {
+    auto inputs = options.inputs;
+    if (inputs.empty()) { inputs.push_back("-"); }
+    std::vector<InputShard> shards;
+    for (const auto path : inputs) {
+        int fd = STDIN_FILENO;
+        if (std::strcmp(path, "-")) {
+            fd = open(path, O_RDONLY | O_CLOEXEC);
+            if (fd < 0) { throw std::system_error(errno, std::generic_category(), path); }
+        }
+
+        InputShard shard;
+        shard.block = map_input(fd);
+        if (!shard.block) {
+            // read as a stream, so it's needed until the end
+            shard.fd = fd;
+            shards.push_back(shard);
+            continue;
+        }
+        if (fd != STDIN_FILENO) { close(fd); }
+
+        auto bounds = split_shards(*shard.block, options.shards);
+        if (options.binary) {
+            const auto records = shard.block->size() / sizeof(BinaryEquation);
+            for (std::size_t i = 1; i < options.shards; ++i) {
+                bounds[i] = records * i / options.shards * sizeof(BinaryEquation);
+            }
+        }
+        for (std::size_t i = 0; i + 1 < bounds.size(); ++i) {
+            shard.begin = bounds[i];
+            shard.end = bounds[i + 1];
+            shard.first = i == 0;
+            shards.push_back(shard);
+        }
+    }
+
+    std::vector<std::size_t> fields(shards.size());
+    parallel_for(pool, std::size_t(0), shards.size(), [&options, &shards, &fields](std::size_t i) {
+        const auto& shard = shards[i];
+        if (shard.block && !options.binary) { fields[i] = count_fields(*shard.block, shard.begin, shard.end); }
+    });
+    std::size_t before = 0;
+    for (std::size_t i = 0; i < shards.size(); ++i) {
+        if (shards[i].first) { before = 0; }
+        shards[i].skip = (3 - before % 3) % 3;
+        before += fields[i];
+    }
+    return shards;
+}
+
+/**
+ * @brief Read the shards, every one by its own thread if there are more.
+ *
+ * The calling thread gets the chunks in the input order.
+ *
+ * @param shards the input
+ * @param read reads a shard, calling its second argument with every
+ *  chunk, the argument may take the chunk
+ * @param submit called with every chunk, may take it
+ */
+template <typename Chunk, typename Read, typename Submit>
+static void read_shards(const std::vector<InputShard>& shards, Read& read, Submit submit) {
+    if (shards.size() == 1) {
+        read(shards[0], submit);
+        return;
+    }
+
+    std::vector<ChunkQueue<Chunk>> queues(shards.size());
+    std::vector<std::thread> readers;
+    readers.reserve(shards.size());
+    for (std::size_t i = 0; i < shards.size(); ++i) {
+        readers.emplace_back([&read, &shard = shards[i], &queue = queues[i], i] {
+            if (Tracer::enabled()) { Tracer::name_thread("reader " + std::to_string(i)); }
+            read(shard, [&queue](Chunk& chunk) { queue.push(std::move(chunk)); });
+            queue.close();
+        });
+    }
+    Chunk chunk;
+    for (auto& queue : queues) {
+        while (queue.pop(chunk)) { submit(chunk); }
+    }
+    for (auto& reader : readers) { reader.join(); }
+}
+
 /**
  * @brief Entry point function
  *
@@ -28,32 +417,203 @@
  * @return Result of program operation
  */
 int main(int argc, char* argv[]) {
-    // main thread reads cin, printer thread writes to cout,
-    // that's why worker pool is nthread-2.
-    WorkerPool worker_pool(WorkerPool::nthreads - 2);
+    const auto options = parse_options(argc, argv);
+
+    if (!options.trace.empty()) {
+        // before any thread starts, so they leave SIGUSR1 to the dumping thread
+        Tracer::enable();
+        Tracer::dump_on_signal(SIGUSR1, options.trace);
+        Tracer::name_thread("main");
+    }
+
+    // main thread reads the input (or sends on the chunks of the shard
+    // readers), printer thread writes to cout,
+    // that's why worker pool is nthread-2, but at least one worker.
+    // The printer is the only consumer, so answers can go via the ring,
+    // a chunk at once, and the printer wakes up once per chunk.
+    // Reader and printer take the first two placement slots, workers the rest.
+    const auto slots = placement_slots(options.placement);
+    WorkerPoolOptions pool_options;
+    pool_options.completion = options.unordered ? Completion::unordered : Completion::batched;
+    // as many equations in flight as the ring of single answers had,
+    // but a few chunks even when they are big: the reader fills the next
+    // ones while the workers solve and the printer writes
+    pool_options.ring_size = std::max<std::size_t>(4, pool_options.ring_size / options.chunk_size);
+    pool_options.placement = options.placement;
+    pool_options.placement_offset = 2;
+    pool_options.stats = options.print_stats;
+    // the greeting would get into the packed answers
+    pool_options.verbose = !options.binary;
+    pool_options.max_threads = std::max(WorkerPool::nthreads, 3u) - 2;
+    pool_options.autoscale.enabled = options.autoscale;
+    WorkerPool worker_pool(options.autoscale ? 1 : pool_options.max_threads, pool_options);
 
-    auto printer = std::thread([&worker_pool]{
-        for (;;) {
-            auto result = worker_pool.get_answer();
-            if (!result) { break; }
-            // only 1 thread prints, so no need to guard cout
-            std::cout << *result << std::endl;
+    int status = EXIT_SUCCESS;
+    auto flush_output = [&status](OutputWriter& output) {
+        try {
+            output.flush();
+        } catch (const std::system_error& e) {
+            std::cerr << e.what() << std::endl;
+            status = EXIT_FAILURE;
         }
-    });
+    };
+
+    // With --transform the main thread prints the chunks it solved
+    std::optional<OutputWriter> output;
+    std::thread printer;
+    if (options.transform && options.pipeline.empty()) {
+        output.emplace(STDOUT_FILENO, 1 << 16, options.flush_interval);
+    } else {
+        printer = std::thread([&worker_pool, &options, &slots, &flush_output]{
+            Tracer::name_thread("printer");
+            // the writer's thread inherits this placement
+            if (!slots.empty()) { pin_current_thread(slots[1 % slots.size()]); }
+            // answers are buffered and written by the writer's own thread
+            OutputWriter output(STDOUT_FILENO, 1 << 16, options.flush_interval);
+            std::vector<WorkerPool::Answer> results;
+            while (worker_pool.get_answers(results)) {
+                for (auto& result : results) {
+                    if (options.binary) {
+                        output.write(result);
+                    } else {
+                        output.write_line(result);
+                    }
+                    WorkerPool::recycle(std::move(result));
+                }
+                results.clear();
+            }
+            flush_output(output);
+        });
+    }
+
+    std::optional<AnswerCache> cache;
+    if (options.cache_size) { cache.emplace(options.cache_size); }
+    const Solve solve{cache ? &*cache : nullptr};
+
+    std::vector<Equation> chunk;
+    chunk.reserve(options.chunk_size);
+    std::vector<WorkerPool::Answer> answers;
+    SolverPipeline pipeline(worker_pool, options.pipeline, solve.cache);
+    auto flush = [&] {
+        if (!options.pipeline.empty()) {
+            if (chunk.empty()) { return; }
+            auto batch = std::make_unique<EquationBatch>();
+            for (auto& [block, a, b, c] : chunk) { batch->add(block, {a, b, c}); }
+            pipeline.submit(std::move(batch));
+        } else if (output) {
+            answers.resize(chunk.size());
+            parallel_transform(worker_pool, chunk.begin(), chunk.end(), answers.begin(), solve, transform_grain);
+            for (auto& answer : answers) {
+                output->write_line(answer);
+                WorkerPool::recycle(std::move(answer));
+            }
+        } else {
+            worker_pool.set_jobs(solve, std::make_move_iterator(chunk.begin()),
+                                 std::make_move_iterator(chunk.end()));
+        }
+        chunk.clear();
+    };
 
-    std::array<std::string, 3> input;
-    for (int cnt = 0; std::cin >> input[cnt++]; ) {
-        if (cnt == 3) {
-            cnt = 0;
-            worker_pool.set_job(calculate_square_roots,
-                                {std::move(input[0]), std::move(input[1]), std::move(input[2])});
+    if (!slots.empty()) { pin_current_thread(slots[0]); }
+
+    std::atomic<bool> read_failed{false};
+    // call the function with every chunk of the shard, it may take the chunk
+    auto read_text = [&options, &read_failed](const InputShard& shard, auto&& emit) {
+        std::vector<Equation> chunk;
+        chunk.reserve(options.chunk_size);
+        try {
+            auto reader = shard.reader();
+            std::array<std::string_view, 3> coefs;
+            while (reader.next(coefs)) {
+                chunk.emplace_back(reader.current(), coefs[0], coefs[1], coefs[2]);
+                if (chunk.size() == options.chunk_size) {
+                    emit(chunk);
+                    chunk.clear();
+                    chunk.reserve(options.chunk_size);
+                }
+            }
+        } catch (const std::system_error& e) {
+            std::cerr << e.what() << std::endl;
+            read_failed = true;
+        }
+        if (!chunk.empty()) { emit(chunk); }
+    };
+    auto read_binary = [&options, &read_failed](const InputShard& shard, auto&& emit) {
+        BinaryChunk chunk;
+        try {
+            auto reader = shard.reader();
+            while (const char* record = reader.next_record(sizeof(BinaryEquation))) {
+                // a refilled block starts a new chunk
+                if (chunk.count && !chunk.continued_by(record)) {
+                    emit(chunk);
+                    chunk = {};
+                }
+                if (!chunk.count) {
+                    chunk.block = reader.current();
+                    chunk.records = record;
+                }
+                if (++chunk.count == options.chunk_size) {
+                    emit(chunk);
+                    chunk = {};
+                }
+            }
+        } catch (const std::system_error& e) {
+            std::cerr << e.what() << std::endl;
+            read_failed = true;
+        }
+        if (chunk.count) { emit(chunk); }
+    };
+
+    std::vector<InputShard> shards;
+    try {
+        if (options.inputs.empty() && options.shards == 1) {
+            InputShard shard;
+            shard.fd = STDIN_FILENO;
+            shards.push_back(shard);
+        } else {
+            shards = open_shards(options, worker_pool);
         }
+    } catch (const std::system_error& e) {
+        std::cerr << e.what() << std::endl;
+        read_failed = true;
+    }
+
+    if (options.binary) {
+        const SolveBinary solve_binary;
+        read_shards<BinaryChunk>(shards, read_binary, [&](BinaryChunk& part) {
+            worker_pool.set_job(solve_binary, std::move(part));
+        });
+    } else {
+        // the chunk comes back empty, keeping its capacity
+        read_shards<std::vector<Equation>>(shards, read_text, [&](std::vector<Equation>& part) {
+            std::swap(chunk, part);
+            flush();
+        });
+    }
+    for (const auto& shard : shards) {
+        if (shard.fd > STDIN_FILENO) { close(shard.fd); }
     }
 
     // stop workers to release printer thread
     worker_pool.stop();
-    printer.join();
+    if (printer.joinable()) { printer.join(); }
+    if (output) { flush_output(*output); }
+
+    if (!options.trace.empty()) {
+        try {
+            Tracer::dump(options.trace);
+        } catch (const std::system_error& e) {
+            std::cerr << e.what() << std::endl;
+            status = EXIT_FAILURE;
+        }
+    }
+
+    if (options.print_stats) {
+        std::cerr << worker_pool.stats();
+        if (!options.pipeline.empty()) { std::cerr << pipeline; }
+        if (cache) { std::cerr << cache->stats(); }
+    }
 
-    return 0;
+    return read_failed ? EXIT_FAILURE : status;
 }
 
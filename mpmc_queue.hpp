@@ -0,0 +1,137 @@
+/**
+ * @file mpmc_queue.hpp
+ * @author Albert Kharisov <albkharisov@gmail.com>
+ * @version 1.0
+ *
+ * @brief Bounded lock-free queue for many producers and many consumers.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include "result_ring.hpp"
+
+/**
+ * @brief Bounded MPMC queue (Dmitry Vyukov's design).
+ *
+ * Every cell has a sequence number telling whose turn it is: the producer
+ * of this lap or the consumer. Producers and consumers claim positions
+ * with a CAS on their own padded counter and never wait for each other,
+ * so nothing here sleeps: a full or empty queue is reported to the caller.
+ *
+ * @tparam T type of the elements, default constructible and movable
+ */
+template <typename T>
+class MpmcQueue {
+    /** Storage of one element */
+    struct alignas(cache_line_size) Cell {
+        /**
+         * State of the cell. For position `p`:
+         * `p` - free to write,
+         * `p + 1` - element is ready,
+         * `p + capacity` - taken, free for the next lap.
+         */
+        std::atomic<std::size_t> seq;
+        /** The element */
+        T value;
+    };
+
+    /** Number of cells, power of 2 */
+    const std::size_t capacity;
+    /** Cells storage */
+    std::unique_ptr<Cell[]> cells;
+
+    /** Next position to write. Producers side */
+    alignas(cache_line_size) std::atomic<std::size_t> head{0};
+    /** Next position to read. Consumers side */
+    alignas(cache_line_size) std::atomic<std::size_t> tail{0};
+
+    /** Round up to power of 2 */
+    static std::size_t round_up(std::size_t n) {
+        std::size_t p = 1;
+        while (p < n) { p <<= 1; }
+        return p;
+    }
+
+    /** Cell for the position */
+    Cell& cell(std::size_t pos) { return cells[pos & (capacity - 1)]; }
+
+public:
+    /**
+     * A constructor.
+     *
+     * @param size maximum number of elements, rounded up to power of 2, \
+     *  at least 2: a single cell taken would look ready for the next lap
+     */
+    explicit MpmcQueue(std::size_t size)
+            : capacity(round_up(std::max<std::size_t>(size, 2))),
+              cells(std::make_unique<Cell[]>(capacity)) {
+        for (std::size_t i = 0; i < capacity; ++i) {
+            cells[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * Add the element if there is a free cell.
+     *
+     * @param value the element, moved from only on success
+     * @return false if the queue is full
+     */
+    bool try_push(T&& value) {
+        auto pos = head.load(std::memory_order_relaxed);
+        for (;;) {
+            auto& c = cell(pos);
+            const auto seq = c.seq.load(std::memory_order_acquire);
+            const auto diff = static_cast<std::ptrdiff_t>(seq - pos);
+            if (diff == 0) {
+                if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    c.value = std::move(value);
+                    c.seq.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                // the consumer of the previous lap hasn't taken it yet
+                return false;
+            } else {
+                pos = head.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /**
+     * Take the oldest element if there is one.
+     *
+     * @param value where to move the element
+     * @return false if the queue is empty
+     */
+    bool try_pop(T& value) {
+        auto pos = tail.load(std::memory_order_relaxed);
+        for (;;) {
+            auto& c = cell(pos);
+            const auto seq = c.seq.load(std::memory_order_acquire);
+            const auto diff = static_cast<std::ptrdiff_t>(seq - (pos + 1));
+            if (diff == 0) {
+                if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    value = std::move(c.value);
+                    // don't keep what the element owns until the next lap
+                    c.value = T();
+                    c.seq.store(pos + capacity, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                // the producer of this position hasn't written it yet
+                return false;
+            } else {
+                pos = tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /** Check if the queue looks empty, may be stale by the time it returns */
+    bool empty() const {
+        return head.load(std::memory_order_relaxed) == tail.load(std::memory_order_relaxed);
+    }
+};
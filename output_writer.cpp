@@ -0,0 +1,119 @@
+/**
+ * @file output_writer.cpp
+ * @author Albert Kharisov <albkharisov@gmail.com>
+ * @version 1.0
+ *
+ * @brief Double-buffered asynchronous output writer.
+ */
+
+#include <cerrno>
+#include <system_error>
+#include <unistd.h>
+
+#include "output_writer.hpp"
+
+
+OutputWriter::OutputWriter(int output_fd, std::size_t buffer_size, std::chrono::milliseconds latency)
+        : fd(output_fd),
+          capacity(buffer_size ? buffer_size : 1),
+          max_latency(latency),
+          thread(&OutputWriter::operator(), this) {
+    std::lock_guard<std::mutex> l(m);
+    front.reserve(capacity);
+    back.reserve(capacity);
+}
+
+OutputWriter::~OutputWriter() {
+    {
+        std::lock_guard<std::mutex> l(m);
+        stop_flag = true;
+    }
+    cv_ready.notify_one();
+    thread.join();
+}
+
+void OutputWriter::append(std::string_view data, bool newline) {
+    const auto size = data.size() + (newline ? 1 : 0);
+
+    std::unique_lock<std::mutex> l(m);
+    if (!front.empty() && front.size() + size > capacity) {
+        swap(l);
+    }
+    if (front.empty() && max_latency.count()) {
+        // start the latency timer of the writer thread
+        front_since = std::chrono::steady_clock::now();
+        cv_ready.notify_one();
+    }
+    front.insert(front.end(), data.begin(), data.end());
+    if (newline) { front.push_back('\n'); }
+}
+
+void OutputWriter::flush() {
+    std::unique_lock<std::mutex> l(m);
+    if (!front.empty()) {
+        swap(l);
+    }
+    const auto target = handed;
+    cv_written.wait(l, [this, target] { return written >= target; });
+    if (error) {
+        throw std::system_error(error, std::generic_category(), "output write failed");
+    }
+}
+
+void OutputWriter::swap(std::unique_lock<std::mutex>& l) {
+    cv_written.wait(l, [this] { return !back_ready; });
+    std::swap(front, back);
+    back_ready = true;
+    ++handed;
+    cv_ready.notify_one();
+}
+
+int OutputWriter::write_all(const std::vector<char>& buf) {
+    const char* p = buf.data();
+    auto left = buf.size();
+    while (left) {
+        auto n = ::write(fd, p, left);
+        if (n < 0) {
+            if (errno == EINTR) { continue; }
+            return errno;
+        }
+        p += n;
+        left -= static_cast<std::size_t>(n);
+    }
+    return 0;
+}
+
+void OutputWriter::operator()() {
+    std::unique_lock<std::mutex> l(m);
+    for (;;) {
+        if (!back_ready && !front.empty()) {
+            const bool expired = max_latency.count()
+                && std::chrono::steady_clock::now() >= front_since + max_latency;
+            if (expired || stop_flag) {
+                std::swap(front, back);
+                back_ready = true;
+                ++handed;
+            }
+        }
+
+        if (back_ready) {
+            l.unlock();
+            const int err = write_all(back);
+            l.lock();
+            if (err && !error) { error = err; }
+            back.clear();
+            back_ready = false;
+            ++written;
+            cv_written.notify_all();
+            continue;
+        }
+
+        if (stop_flag) { break; }
+
+        if (max_latency.count() && !front.empty()) {
+            cv_ready.wait_until(l, front_since + max_latency);
+        } else {
+            cv_ready.wait(l);
+        }
+    }
+}
@@ -0,0 +1,122 @@
+/**
+ * @file output_writer.hpp
+ * @author Albert Kharisov <albkharisov@gmail.com>
+ * @version 1.0
+ *
+ * @brief Double-buffered asynchronous output writer.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Asynchronous writer to a file descriptor.
+ *
+ * Data is appended to the front buffer. When it's full, buffers are
+ * swapped and the back one is written by the writer's own thread
+ * with as few write(2) calls as possible, while the front one is filled.
+ *
+ * For interactive use the front buffer is also written once its oldest
+ * data waits longer than `max_latency`.
+ *
+ * Usage example:
+ *
+ *      OutputWriter out(STDOUT_FILENO);
+ *      out.write_line("answer");
+ *      out.flush();
+ */
+class OutputWriter {
+    /** File descriptor to write to */
+    const int fd;
+    /** Buffer size making the buffers swap */
+    const std::size_t capacity;
+    /** Maximum time data waits in the front buffer, 0 to wait till it's full */
+    const std::chrono::milliseconds max_latency;
+
+    /** Buffer being filled */
+    std::vector<char> front;
+    /** Buffer being written */
+    std::vector<char> back;
+    /** Time the oldest data came to the front buffer */
+    std::chrono::steady_clock::time_point front_since;
+    /** Back buffer is handed to the writer thread */
+    bool back_ready = false;
+    /** Number of the front buffers handed to the writer thread */
+    std::size_t handed = 0;
+    /** Number of the handed buffers written */
+    std::size_t written = 0;
+    /** Writer thread has to exit */
+    bool stop_flag = false;
+    /** errno of the failed write, 0 if none */
+    int error = 0;
+
+    /** Mutex for the buffers */
+    std::mutex m;
+    /** Condvar for the writer thread: buffer is ready or stop */
+    std::condition_variable cv_ready;
+    /** Condvar for the producer: back buffer is written */
+    std::condition_variable cv_written;
+
+    /** Thread writing the back buffer, has to be initialized last */
+    std::thread thread;
+
+    /** Writer thread function */
+    void operator()();
+    /**
+     * Hand the front buffer to the writer thread.
+     * Waits until the back buffer is written.
+     */
+    void swap(std::unique_lock<std::mutex>& l);
+    /** Append data, optionally followed by a new line */
+    void append(std::string_view data, bool newline);
+    /** Write all bytes with write(2), returns errno or 0 */
+    int write_all(const std::vector<char>& buf);
+
+public:
+    /**
+     * A constructor. Starts writer thread.
+     *
+     * @param output_fd file descriptor to write to
+     * @param buffer_size size of each of the two buffers
+     * @param latency maximum time data waits before being written, \
+     *  0 to write only full buffers
+     */
+    explicit OutputWriter(int output_fd, std::size_t buffer_size = 1 << 16,
+                          std::chrono::milliseconds latency = std::chrono::milliseconds(0));
+
+    /** A destructor. Writes everything and stops writer thread. */
+    ~OutputWriter();
+
+    /** Forbid this. Writer thread refers to the object */
+    OutputWriter(const OutputWriter&) = delete;
+    /** Forbid this. Writer thread refers to the object */
+    OutputWriter& operator=(const OutputWriter&) = delete;
+
+    /**
+     * Append data. Blocks only if both buffers are full.
+     *
+     * @param data bytes to write
+     */
+    void write(std::string_view data) { append(data, false); }
+
+    /**
+     * Append data and a new line.
+     *
+     * @param line bytes to write
+     */
+    void write_line(std::string_view line) { append(line, true); }
+
+    /**
+     * Write everything appended so far. Blocking.
+     *
+     * @throw std::system_error if any write failed
+     */
+    void flush();
+};
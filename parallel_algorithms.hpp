@@ -0,0 +1,287 @@
+/**
+ * @file parallel_algorithms.hpp
+ * @author Albert Kharisov <albkharisov@gmail.com>
+ * @version 1.0
+ *
+ * @brief Parallel loops over ranges on top of the worker pool.
+ *
+ * The range is split into chunks claimed one by one by the calling thread
+ * and by helper jobs posted to the pool. Chunks start large and shrink
+ * down to the grain size towards the end of the range, so the claims are
+ * few and the participants finish together. The caller works instead of
+ * blocking, so the loops may be nested or called from the jobs.
+ *
+ * Usage example:
+ *
+ *      WorkerPool pool;
+ *      std::vector<int> v(1000000, 1);
+ *      parallel_for(pool, v.begin(), v.end(), [](int& x) { x *= 2; });
+ *      parallel_transform(pool, v.begin(), v.end(), v.begin(), [](int x) { return x + 1; });
+ *      long sum = parallel_reduce(pool, v.begin(), v.end(), 0L, std::plus<>());
+ *      parallel_for(pool, 0, 100, [](int i) { ... }, 10);
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "worker_pool.hpp"
+
+namespace parallel_detail {
+
+/**
+ * @brief Range being processed, shared by the caller and the helpers.
+ *
+ * Helpers may start after the loop is over, so it's owned by all of them.
+ */
+struct Partition {
+    /** Number of elements */
+    const std::size_t size;
+    /** Smallest chunk */
+    const std::size_t grain;
+    /** Caller and the helpers */
+    const std::size_t participants;
+    /** First element not claimed yet */
+    std::atomic<std::size_t> next{0};
+    /** Number of elements done or skipped after a failure */
+    std::atomic<std::size_t> done{0};
+    /** Mutex for the caller waiting and for `error` */
+    std::mutex m;
+    /** Condvar for the caller waiting for the chunks of the helpers */
+    std::condition_variable cv;
+    /** First exception thrown by the loop body */
+    std::exception_ptr error;
+
+    /** A constructor */
+    Partition(std::size_t n, std::size_t min_chunk, std::size_t threads)
+            : size(n), grain(min_chunk), participants(threads) {}
+
+    /**
+     * Claim the next chunk. Every chunk is a share of what is left,
+     * but not smaller than the grain.
+     *
+     * @param begin first element of the chunk
+     * @param end element after the chunk
+     * @return false if the whole range is claimed
+     */
+    bool claim(std::size_t& begin, std::size_t& end) {
+        auto pos = next.load(std::memory_order_relaxed);
+        for (;;) {
+            if (pos >= size) { return false; }
+            const auto left = size - pos;
+            const auto n = std::min(left, std::max(grain, left / (2 * participants)));
+            if (next.compare_exchange_weak(pos, pos + n)) {
+                begin = pos;
+                end = pos + n;
+                return true;
+            }
+        }
+    }
+
+    /** Account `n` elements done, the last ones wake the caller */
+    void finish(std::size_t n) {
+        if (done.fetch_add(n) + n != size) { return; }
+        { std::lock_guard<std::mutex> l(m); }
+        cv.notify_all();
+    }
+
+    /**
+     * Keep the exception and skip the rest of the range.
+     *
+     * @param e exception thrown by the body
+     * @param n number of elements of the failed chunk
+     */
+    void fail(std::exception_ptr e, std::size_t n) {
+        {
+            std::lock_guard<std::mutex> l(m);
+            if (!error) { error = std::move(e); }
+        }
+        const auto pos = next.exchange(size);
+        finish(n + (pos < size ? size - pos : 0));
+    }
+
+    /** Process chunks until the whole range is claimed */
+    template <typename Body>
+    void run(Body& body) {
+        std::size_t begin;
+        std::size_t end;
+        while (claim(begin, end)) {
+            try {
+                body(begin, end);
+            } catch (...) {
+                fail(std::current_exception(), end - begin);
+                return;
+            }
+            finish(end - begin);
+        }
+    }
+
+    /** Wait for the chunks claimed by the others, rethrows the exception of the body */
+    void wait() {
+        std::unique_lock<std::mutex> l(m);
+        cv.wait(l, [this] { return done.load() == size; });
+        if (error) { std::rethrow_exception(error); }
+    }
+};
+
+/**
+ * @brief Partition and the loop body, owned by the caller and the helpers.
+ *
+ * A helper starting after the loop is over finds nothing to claim and
+ * only drops its share. The bodies keep their callables and results by
+ * value, so the last share may go after the caller has returned.
+ */
+template <typename Body>
+struct Loop {
+    /** The range */
+    Partition partition;
+    /** Called with the chunks */
+    Body body;
+
+    /** A constructor */
+    Loop(std::size_t n, std::size_t min_chunk, std::size_t threads, Body&& f)
+            : partition(n, min_chunk, threads), body(std::move(f)) {}
+
+    /** Process chunks until the whole range is claimed */
+    void run() { partition.run(body); }
+};
+
+/**
+ * Run `body(begin, end)` for the chunks of [0, size) on the pool
+ * and the calling thread. Returns when all of them are done.
+ */
+template <typename Body>
+void parallel_chunks(WorkerPool& pool, std::size_t size, std::size_t grain, Body body) {
+    if (size == 0) { return; }
+    grain = std::max<std::size_t>(grain, 1);
+    const auto chunks = (size + grain - 1) / grain;
+    const auto helpers = std::min<std::size_t>(pool.size(), chunks - 1);
+
+    auto loop = std::make_shared<Loop<Body>>(size, grain, helpers + 1, std::move(body));
+    for (std::size_t i = 0; i < helpers; ++i) {
+        pool.post([loop] { loop->run(); });
+    }
+    loop->run();
+    loop->partition.wait();
+}
+
+/** Element `i` of the range: the iterator's value or the integer itself */
+template <typename It>
+decltype(auto) element(It first, std::size_t i) {
+    if constexpr (std::is_integral_v<It>) {
+        return static_cast<It>(first + static_cast<It>(i));
+    } else {
+        return *(first + i);
+    }
+}
+
+/** Number of elements of the range */
+template <typename It>
+std::size_t distance(It first, It last) {
+    if constexpr (std::is_integral_v<It>) {
+        return last > first ? static_cast<std::size_t>(last - first) : 0;
+    } else {
+        return static_cast<std::size_t>(std::distance(first, last));
+    }
+}
+
+/**
+ * @brief Callable and chunk results of parallel_reduce(), shared by its body and the caller.
+ */
+template <typename T, typename Op>
+struct Reduction {
+    /** The operation */
+    Op op;
+    /** Mutex for `partials` */
+    std::mutex m;
+    /** Chunk results by their first element */
+    std::vector<std::pair<std::size_t, T>> partials;
+
+    /** A constructor */
+    explicit Reduction(Op&& o) : op(std::move(o)) {}
+};
+
+} // namespace parallel_detail
+
+/**
+ * @brief Call `f` for every element of the range in parallel.
+ *
+ * @param pool worker pool to run on, the calling thread takes part too
+ * @param first beginning of the range: random access iterator or integer
+ * @param last end of the range
+ * @param f called with the element (or the integer), exceptions are rethrown, \
+ *  copied (moved if it's an rvalue) into the loop
+ * @param grain smallest number of elements processed at once
+ */
+template <typename It, typename F>
+void parallel_for(WorkerPool& pool, It first, It last, F&& f, std::size_t grain = 1) {
+    parallel_detail::parallel_chunks(pool, parallel_detail::distance(first, last), grain,
+                                     [first, f = std::forward<F>(f)](std::size_t begin, std::size_t end) mutable {
+        for (auto i = begin; i < end; ++i) { f(parallel_detail::element(first, i)); }
+    });
+}
+
+/**
+ * @brief Write `f` of every element of the range to `out` in parallel.
+ *
+ * @param pool worker pool to run on, the calling thread takes part too
+ * @param first beginning of the range: random access iterator or integer
+ * @param last end of the range
+ * @param out beginning of the output range, random access
+ * @param f called with the element (or the integer), exceptions are rethrown, \
+ *  copied (moved if it's an rvalue) into the loop
+ * @param grain smallest number of elements processed at once
+ * @return end of the output range
+ */
+template <typename It, typename Out, typename F>
+Out parallel_transform(WorkerPool& pool, It first, It last, Out out, F&& f, std::size_t grain = 1) {
+    const auto size = parallel_detail::distance(first, last);
+    parallel_detail::parallel_chunks(pool, size, grain,
+                                     [first, out, f = std::forward<F>(f)](std::size_t begin, std::size_t end) mutable {
+        for (auto i = begin; i < end; ++i) { out[i] = f(parallel_detail::element(first, i)); }
+    });
+    return out + size;
+}
+
+/**
+ * @brief Fold the range with `op` in parallel.
+ *
+ * Every chunk is folded on its own, then the results of the chunks
+ * are folded into `init` in the order of the range. So `op` has to be
+ * associative, but doesn't have to be commutative.
+ *
+ * @param pool worker pool to run on, the calling thread takes part too
+ * @param first beginning of the range: random access iterator or integer
+ * @param last end of the range
+ * @param init initial value
+ * @param op binary operation, called as `op(T, element)` and `op(T, T)`
+ * @param grain smallest number of elements processed at once
+ * @return `init` folded with all elements
+ */
+template <typename It, typename T, typename Op>
+T parallel_reduce(WorkerPool& pool, It first, It last, T init, Op op, std::size_t grain = 1) {
+    auto state = std::make_shared<parallel_detail::Reduction<T, Op>>(std::move(op));
+
+    parallel_detail::parallel_chunks(pool, parallel_detail::distance(first, last), grain,
+                                     [first, state](std::size_t begin, std::size_t end) {
+        T acc(parallel_detail::element(first, begin));
+        for (auto i = begin + 1; i < end; ++i) { acc = state->op(std::move(acc), parallel_detail::element(first, i)); }
+        std::lock_guard<std::mutex> l(state->m);
+        state->partials.emplace_back(begin, std::move(acc));
+    });
+
+    auto& partials = state->partials;
+    std::sort(partials.begin(), partials.end(),
+              [](const auto& l, const auto& r) { return l.first < r.first; });
+    for (auto& p : partials) { init = state->op(std::move(init), std::move(p.second)); }
+    return init;
+}
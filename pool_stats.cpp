@@ -0,0 +1,86 @@
+/**
+ * @file pool_stats.cpp
+ * @author Albert Kharisov <albkharisov@gmail.com>
+ * @version 1.0
+ *
+ * @brief Counters of the worker pool and their snapshot.
+ */
+
+#include <ostream>
+#include "pool_stats.hpp"
+
+
+std::uint64_t LatencyHistogram::total() const {
+    std::uint64_t n = 0;
+    for (auto c : counts) { n += c; }
+    return n;
+}
+
+std::chrono::nanoseconds LatencyHistogram::percentile(double p) const {
+    const auto n = total();
+    if (n == 0) { return std::chrono::nanoseconds(0); }
+
+    const auto rank = static_cast<std::uint64_t>(p * (n - 1));
+    std::uint64_t seen = 0;
+    for (std::size_t i = 0; i < counts.size(); ++i) {
+        seen += counts[i];
+        if (seen > rank) { return std::chrono::nanoseconds(std::uint64_t{2} << i); }
+    }
+    return std::chrono::nanoseconds(std::uint64_t{2} << (counts.size() - 1));
+}
+
+LatencyHistogram& LatencyHistogram::operator+=(const LatencyHistogram& other) {
+    for (std::size_t i = 0; i < counts.size(); ++i) { counts[i] += other.counts[i]; }
+    return *this;
+}
+
+void StatsSlot::record(std::array<Counter, latency_buckets>& histogram, std::chrono::nanoseconds latency) {
+    auto ns = static_cast<std::uint64_t>(latency.count() > 0 ? latency.count() : 0);
+    std::size_t bucket = 0;
+    while (ns > 1 && bucket + 1 < latency_buckets) {
+        ns >>= 1;
+        ++bucket;
+    }
+    histogram[bucket].add(1);
+}
+
+WorkerStats StatsSlot::snapshot() const {
+    WorkerStats s;
+    s.started = started.get();
+    s.completed = completed.get();
+    s.busy = std::chrono::nanoseconds(busy.get());
+    s.idle = std::chrono::nanoseconds(idle.get());
+    s.jobs_lock_wait = std::chrono::nanoseconds(jobs_lock_wait.get());
+    for (std::size_t i = 0; i < latency_buckets; ++i) {
+        s.queue_latency.counts[i] = queue_latency[i].get();
+        s.run_latency.counts[i] = run_latency[i].get();
+    }
+    return s;
+}
+
+std::ostream& operator<<(std::ostream& out, const PoolStats& stats) {
+    if (!stats.enabled) { return out << "stats are disabled" << std::endl; }
+
+    using ms = std::chrono::duration<double, std::milli>;
+    using us = std::chrono::duration<double, std::micro>;
+    auto latency = [&out](const char* name, const LatencyHistogram& h) {
+        out << name << " p50<" << us(h.percentile(0.5)).count() << "us"
+            << " p99<" << us(h.percentile(0.99)).count() << "us"
+            << " max<" << us(h.percentile(1)).count() << "us" << std::endl;
+    };
+
+    out << "jobs: submitted " << stats.submitted << ", completed " << stats.completed
+        << ", cancelled " << stats.cancelled << ", pending " << stats.pending << ", max pending " << stats.max_pending << std::endl;
+    out << "lock wait: jobs " << ms(stats.jobs_lock_wait).count() << "ms"
+        << ", results " << ms(stats.results_lock_wait).count() << "ms" << std::endl;
+    latency("queue latency:", stats.queue_latency);
+    latency("run latency:", stats.run_latency);
+    for (std::size_t i = 0; i < stats.workers.size(); ++i) {
+        const auto& w = stats.workers[i];
+        out << "worker " << i << ": completed " << w.completed
+            << ", busy " << ms(w.busy).count() << "ms"
+            << ", idle " << ms(w.idle).count() << "ms"
+            << ", lock wait " << ms(w.jobs_lock_wait).count() << "ms" << std::endl;
+    }
+    return out;
+}
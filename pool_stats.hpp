@@ -0,0 +1,190 @@
+/**
+ * @file pool_stats.hpp
+ * @author Albert Kharisov <albkharisov@gmail.com>
+ * @version 1.0
+ *
+ * @brief Counters of the worker pool and their snapshot.
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <mutex>
+#include <vector>
+
+/**
+ * Collect stats at all. Define to 0 to compile the counters out,
+ * then WorkerPoolOptions::stats is ignored.
+ */
+#ifndef WORKER_POOL_STATS
+#define WORKER_POOL_STATS 1
+#endif
+
+/** Number of buckets of the latency histograms */
+inline constexpr std::size_t latency_buckets = 40;
+
+/**
+ * @brief Latency histogram with power of two buckets.
+ *
+ * Bucket `i` counts latencies in [2^i, 2^(i+1)) nanoseconds,
+ * bucket 0 also counts zero latencies, the last one everything above.
+ */
+struct LatencyHistogram {
+    /** Number of latencies in each bucket */
+    std::array<std::uint64_t, latency_buckets> counts{};
+
+    /** Number of latencies */
+    std::uint64_t total() const;
+
+    /**
+     * @brief Upper bound of the bucket with the `p`-th fraction of latencies.
+     *
+     * @param p fraction of latencies, 0.5 for the median
+     * @return latency, 0 if there are no latencies
+     */
+    std::chrono::nanoseconds percentile(double p) const;
+
+    /** Merge with another histogram */
+    LatencyHistogram& operator+=(const LatencyHistogram& other);
+};
+
+/**
+ * @brief Snapshot of the counters of one worker.
+ */
+struct WorkerStats {
+    /** Jobs taken from the queues */
+    std::uint64_t started = 0;
+    /** Jobs done */
+    std::uint64_t completed = 0;
+    /** Time spent in jobs */
+    std::chrono::nanoseconds busy{0};
+    /** Time spent between jobs: spinning, stealing, parked */
+    std::chrono::nanoseconds idle{0};
+    /** Time spent waiting for the jobs mutex */
+    std::chrono::nanoseconds jobs_lock_wait{0};
+    /** Time from submitting to starting of the job */
+    LatencyHistogram queue_latency;
+    /** Time from starting to finishing of the job */
+    LatencyHistogram run_latency;
+};
+
+/**
+ * @brief Snapshot of the counters of the worker pool.
+ *
+ * Counters are read one by one while the pool runs,
+ * so the snapshot is consistent only for an idle pool.
+ */
+struct PoolStats {
+    /** Counters are collected, everything below is zero if not */
+    bool enabled = false;
+    /** Jobs submitted */
+    std::uint64_t submitted = 0;
+    /** Jobs done */
+    std::uint64_t completed = 0;
+    /** Jobs discarded by `WorkerPool::cancel()` */
+    std::uint64_t cancelled = 0;
+    /** Jobs waiting in the queues */
+    std::size_t pending = 0;
+    /** High-water mark of the jobs waiting in the queues */
+    std::size_t max_pending = 0;
+    /** Time producers and workers spent waiting for the jobs mutex */
+    std::chrono::nanoseconds jobs_lock_wait{0};
+    /** Time producers and consumers spent waiting for the results mutex */
+    std::chrono::nanoseconds results_lock_wait{0};
+    /** Time from submitting to starting, all workers */
+    LatencyHistogram queue_latency;
+    /** Time from starting to finishing, all workers */
+    LatencyHistogram run_latency;
+    /** Counters of every worker */
+    std::vector<WorkerStats> workers;
+};
+
+/** Print the snapshot in a human readable form */
+std::ostream& operator<<(std::ostream& out, const PoolStats& stats);
+
+/**
+ * @brief Counters updated by one thread, padded to own cache lines.
+ *
+ * Only the owner writes, so the counters are updated with relaxed
+ * load and store instead of read-modify-write.
+ */
+struct alignas(64) StatsSlot {
+    /** Counter with a single writer */
+    struct Counter {
+        /** Value */
+        std::atomic<std::uint64_t> value{0};
+        /** Add to the value, only the owner may call it */
+        void add(std::uint64_t n) {
+            value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+        }
+        /** Read the value from any thread */
+        std::uint64_t get() const { return value.load(std::memory_order_relaxed); }
+    };
+
+    /** Jobs taken from the queues */
+    Counter started;
+    /** Jobs done */
+    Counter completed;
+    /** Nanoseconds spent in jobs */
+    Counter busy;
+    /** Nanoseconds spent between jobs */
+    Counter idle;
+    /** Nanoseconds spent waiting for the jobs mutex */
+    Counter jobs_lock_wait;
+    /** See WorkerStats::queue_latency */
+    std::array<Counter, latency_buckets> queue_latency;
+    /** See WorkerStats::run_latency */
+    std::array<Counter, latency_buckets> run_latency;
+
+    /** Account one latency in the histogram */
+    static void record(std::array<Counter, latency_buckets>& histogram, std::chrono::nanoseconds latency);
+    /** Read the counters */
+    WorkerStats snapshot() const;
+};
+
+/**
+ * Lock the mutex, adding the time spent waiting for it to `wait_ns`.
+ * Clock is read only if the mutex is contended.
+ *
+ * @param l lock to acquire
+ * @param wait_ns counter of the waiting time, nullptr to just lock
+ */
+inline void lock_counted(std::unique_lock<std::mutex>& l, std::atomic<std::uint64_t>* wait_ns) {
+    if (!wait_ns) {
+        l.lock();
+        return;
+    }
+    if (l.try_lock()) { return; }
+
+    const auto start = std::chrono::steady_clock::now();
+    l.lock();
+    const auto waited = std::chrono::steady_clock::now() - start;
+    wait_ns->fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(waited).count(),
+                       std::memory_order_relaxed);
+}
+
+/**
+ * @brief Counters of the pool shared by all producers and workers.
+ */
+struct alignas(64) PoolCounters {
+    /** Nanoseconds producers spent waiting for the jobs mutex */
+    std::atomic<std::uint64_t> jobs_lock_wait{0};
+    /** Nanoseconds producers and consumers spent waiting for the results mutex */
+    std::atomic<std::uint64_t> results_lock_wait{0};
+    /** High-water mark of the jobs waiting in the queues */
+    std::atomic<std::size_t> max_pending{0};
+    /** Jobs discarded by `WorkerPool::cancel()` */
+    std::atomic<std::uint64_t> cancelled{0};
+
+    /** Raise the high-water mark up to `depth` */
+    void update_max_pending(std::size_t depth) {
+        auto current = max_pending.load(std::memory_order_relaxed);
+        while (depth > current &&
+               !max_pending.compare_exchange_weak(current, depth, std::memory_order_relaxed)) {}
+    }
+};
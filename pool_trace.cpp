@@ -0,0 +1,208 @@
+/**
+ * @file pool_trace.cpp
+ * @author Albert Kharisov <albkharisov@gmail.com>
+ * @version 1.0
+ *
+ * @brief Timeline of the jobs of the worker pool in Chrome trace format.
+ */
+
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <pthread.h>
+#include <unistd.h>
+#include "pool_trace.hpp"
+
+
+namespace {
+
+/** Round up to power of 2 */
+std::size_t round_up(std::size_t n) {
+    std::size_t p = 1;
+    while (p < n) { p <<= 1; }
+    return p;
+}
+
+/** Rings of all threads ever traced, in the order of their first event */
+struct Registry {
+    /** Mutex for everything in the registry */
+    std::mutex m;
+    /** The rings, never freed, threads keep pointers to them */
+    std::vector<std::unique_ptr<TraceBuffer>> buffers;
+    /** Events kept per thread */
+    std::size_t capacity = Tracer::default_capacity;
+    /** `trace_clock()` when tracing started, events are dumped relative to it */
+    std::uint64_t start_ticks = 0;
+    /** Steady clock when tracing started, to convert the ticks */
+    std::chrono::steady_clock::time_point start_time;
+};
+
+/** The registry, made on the first use so it outlives every thread */
+Registry& registry() {
+    static auto* r = new Registry;
+    return *r;
+}
+
+/** Write the string as a JSON string */
+void write_string(std::ostream& out, const std::string& s) {
+    out << '"';
+    for (char c : s) {
+        if (c == '"' || c == '\\') {
+            out << '\\' << c;
+        } else if (static_cast<unsigned char>(c) >= ' ') {
+            out << c;
+        }
+    }
+    out << '"';
+}
+
+} // namespace
+
+
+TraceBuffer::TraceBuffer(std::size_t capacity, unsigned id)
+        : mask(round_up(capacity ? capacity : 1) - 1),
+          slots(std::make_unique<Slot[]>(mask + 1)),
+          tid(id) {}
+
+std::vector<TraceBuffer::Entry> TraceBuffer::snapshot() const {
+    const std::uint64_t capacity = mask + 1;
+    const auto end = head.load(std::memory_order_acquire);
+    const auto begin = end > capacity ? end - capacity : 0;
+
+    std::vector<Entry> events;
+    events.reserve(end - begin);
+    for (auto i = begin; i < end; ++i) {
+        // skip the slot if the owner went round and writes it meanwhile
+        const auto& slot = slots[i & mask];
+        if (slot.stamp.load(std::memory_order_acquire) != i + 1) { continue; }
+        const auto time = slot.time.load(std::memory_order_acquire);
+        const auto data = slot.data.load(std::memory_order_acquire);
+        if (slot.stamp.load(std::memory_order_relaxed) != i + 1) { continue; }
+        events.push_back({time, static_cast<TraceEvent>(data >> arg_bits), data & ((std::uint64_t{1} << arg_bits) - 1)});
+    }
+    return events;
+}
+
+TraceBuffer& Tracer::buffer() {
+    thread_local TraceBuffer* own = nullptr;
+    if (!own) {
+        auto& r = registry();
+        std::lock_guard<std::mutex> l(r.m);
+        r.buffers.push_back(std::make_unique<TraceBuffer>(r.capacity, static_cast<unsigned>(r.buffers.size() + 1)));
+        own = r.buffers.back().get();
+    }
+    return *own;
+}
+
+void Tracer::enable(std::size_t capacity) {
+    if (!WORKER_POOL_TRACE) { return; }
+    auto& r = registry();
+    {
+        std::lock_guard<std::mutex> l(r.m);
+        r.capacity = capacity;
+        if (!on.load()) {
+            r.start_ticks = trace_clock();
+            r.start_time = std::chrono::steady_clock::now();
+        }
+    }
+    on.store(true);
+}
+
+void Tracer::name_thread(std::string name) {
+    if (!enabled()) { return; }
+    auto& own = buffer();
+    std::lock_guard<std::mutex> l(registry().m);
+    own.name = std::move(name);
+}
+
+void Tracer::dump(std::ostream& out) {
+    auto& r = registry();
+    const auto end_ticks = trace_clock();
+    const auto end_time = std::chrono::steady_clock::now();
+
+    std::vector<std::pair<unsigned, std::string>> threads;
+    std::vector<std::vector<TraceBuffer::Entry>> events;
+    std::uint64_t start_ticks;
+    std::chrono::steady_clock::time_point start_time;
+    {
+        std::lock_guard<std::mutex> l(r.m);
+        start_ticks = r.start_ticks;
+        start_time = r.start_time;
+        for (const auto& buffer : r.buffers) {
+            threads.emplace_back(buffer->tid, buffer->name);
+            events.push_back(buffer->snapshot());
+        }
+    }
+
+    // ticks of the time stamp counter per microsecond, measured over the whole trace
+    const std::chrono::duration<double, std::micro> elapsed = end_time - start_time;
+    const double ticks_per_us = elapsed.count() > 0 && end_ticks > start_ticks
+                                ? (end_ticks - start_ticks) / elapsed.count() : 1.;
+    const auto pid = ::getpid();
+
+    out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+    bool first = true;
+    auto begin = [&out, &first, pid](const char* name, const char* phase, unsigned tid) {
+        out << (first ? "" : ",\n") << "{\"name\":\"" << name << "\",\"ph\":\"" << phase
+            << "\",\"pid\":" << pid << ",\"tid\":" << tid;
+        first = false;
+    };
+
+    for (std::size_t i = 0; i < threads.size(); ++i) {
+        const auto& [tid, name] = threads[i];
+        begin("thread_name", "M", tid);
+        out << ",\"args\":{\"name\":";
+        write_string(out, name.empty() ? "thread " + std::to_string(tid) : name);
+        out << "}}";
+
+        for (const auto& e : events[i]) {
+            switch (e.event) {
+            case TraceEvent::enqueued: begin("enqueued", "i", tid); break;
+            case TraceEvent::dequeued: begin("job", "B", tid); break;
+            case TraceEvent::finished: begin("job", "E", tid); break;
+            case TraceEvent::consumed: begin("consumed", "i", tid); break;
+            }
+            char ts[32];
+            std::snprintf(ts, sizeof(ts), "%.3f", e.time > start_ticks ? (e.time - start_ticks) / ticks_per_us : 0.);
+            out << ",\"ts\":" << ts;
+            if (e.event == TraceEvent::enqueued || e.event == TraceEvent::consumed) { out << ",\"s\":\"t\""; }
+            out << ",\"args\":{\"job\":" << e.arg << "}}";
+        }
+    }
+    out << "\n]}\n";
+}
+
+void Tracer::dump(const std::string& path) {
+    std::ofstream out(path, std::ios::out | std::ios::trunc);
+    if (!out) { throw std::system_error(errno, std::generic_category(), path); }
+    dump(out);
+    out.close();
+    if (!out) { throw std::system_error(errno ? errno : EIO, std::generic_category(), path); }
+}
+
+void Tracer::dump_on_signal(int signal, std::string path) {
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, signal);
+    if (const int err = pthread_sigmask(SIG_BLOCK, &set, nullptr)) {
+        throw std::system_error(err, std::generic_category(), "pthread_sigmask");
+    }
+
+    // sleeps in sigwait until the process exits, nothing to join
+    std::thread([set, path = std::move(path)] {
+        for (int sig; sigwait(&set, &sig) == 0;) {
+            try {
+                dump(path);
+            } catch (const std::system_error& e) {
+                std::cerr << e.what() << std::endl;
+            }
+        }
+    }).detach();
+}
@@ -0,0 +1,215 @@
+/**
+ * @file pool_trace.hpp
+ * @author Albert Kharisov <albkharisov@gmail.com>
+ * @version 1.0
+ *
+ * @brief Timeline of the jobs of the worker pool in Chrome trace format.
+ *
+ * Every thread records its events into its own ring, so tracing
+ * threads never wait for each other. The rings are dumped as Chrome
+ * trace JSON (chrome://tracing, Perfetto) at exit or on a signal.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/**
+ * Record trace events at all. Define to 0 to compile the tracing out,
+ * then `Tracer::enable()` does nothing.
+ */
+#ifndef WORKER_POOL_TRACE
+#define WORKER_POOL_TRACE 1
+#endif
+
+/**
+ * @brief Event of the timeline of a job.
+ */
+enum class TraceEvent : std::uint8_t {
+    /** Job is queued by `set_job()`, `submit()` and the like, argument is the job */
+    enqueued,
+    /** Worker took the job and starts it, argument is the job */
+    dequeued,
+    /** Job is done, argument is the job */
+    finished,
+    /** Answer is taken by `get_answer()` or `get_answers()`, argument is the job which delivered it */
+    consumed,
+};
+
+/**
+ * Timestamp of the events: the time stamp counter where there is one,
+ * nanoseconds of the steady clock otherwise.
+ */
+inline std::uint64_t trace_clock() noexcept {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+/**
+ * @brief Ring of the events of one thread.
+ *
+ * Only the owner writes, the oldest events are overwritten. The ring
+ * may be read from any thread while the owner writes, events being
+ * overwritten during the read are dropped from the copy.
+ */
+class TraceBuffer {
+    /** Event as it's stored: kind in the top byte of `data`, argument below */
+    struct Slot {
+        /** Number of the event plus 1, 0 while the event is written */
+        std::atomic<std::uint64_t> stamp{0};
+        /** Timestamp, see `trace_clock()` */
+        std::atomic<std::uint64_t> time{0};
+        /** Kind and argument */
+        std::atomic<std::uint64_t> data{0};
+    };
+
+    /** Bits of the argument */
+    static constexpr unsigned arg_bits = 56;
+
+    /** Capacity minus 1, capacity is power of 2 */
+    const std::size_t mask;
+    /** The events */
+    std::unique_ptr<Slot[]> slots;
+    /** Number of events ever recorded */
+    std::atomic<std::uint64_t> head{0};
+
+public:
+    /** Event copied out of the ring */
+    struct Entry {
+        /** Timestamp, see `trace_clock()` */
+        std::uint64_t time;
+        /** Kind of the event */
+        TraceEvent event;
+        /** Argument, lower 56 bits of what was recorded */
+        std::uint64_t arg;
+    };
+
+    /** Thread id in the trace */
+    const unsigned tid;
+    /** Name of the thread in the trace, guarded by the mutex of the tracer */
+    std::string name;
+
+    /**
+     * A constructor.
+     *
+     * @param capacity most events kept, rounded up to power of 2
+     * @param id thread id in the trace
+     */
+    TraceBuffer(std::size_t capacity, unsigned id);
+
+    /** Record the event, only the owner may call it */
+    void record(TraceEvent event, std::uint64_t arg) noexcept {
+        const auto h = head.load(std::memory_order_relaxed);
+        auto& slot = slots[h & mask];
+        // a reader seeing any of the new fields sees the stamp cleared
+        slot.stamp.store(0, std::memory_order_relaxed);
+        slot.time.store(trace_clock(), std::memory_order_release);
+        slot.data.store(static_cast<std::uint64_t>(event) << arg_bits | (arg & ((std::uint64_t{1} << arg_bits) - 1)),
+                        std::memory_order_release);
+        slot.stamp.store(h + 1, std::memory_order_release);
+        head.store(h + 1, std::memory_order_release);
+    }
+
+    /** Copy the events kept, oldest first */
+    std::vector<Entry> snapshot() const;
+};
+
+/**
+ * @brief Process wide tracing of the worker pool.
+ *
+ * Off by default, then recording an event is a relaxed load and a branch.
+ * Threads get their ring on the first event, rings outlive the threads,
+ * so jobs of the workers which left the pool are in the dump too.
+ */
+class Tracer {
+    /** Tracing is on */
+    static inline std::atomic<bool> on{false};
+    /** Last id given to a job */
+    static inline std::atomic<std::uint64_t> last_id{0};
+    /** Job the calling thread runs, see `running_job()` */
+    static inline thread_local std::uint64_t running = 0;
+
+    /** Ring of the calling thread, made on the first call */
+    static TraceBuffer& buffer();
+
+public:
+    /** Events kept per thread by default, 24 bytes each */
+    static constexpr std::size_t default_capacity = std::size_t{1} << 16;
+
+    /**
+     * Start recording. Threads already having a ring keep its capacity.
+     *
+     * @param capacity most events kept per thread
+     */
+    static void enable(std::size_t capacity = default_capacity);
+
+    /** Events are recorded */
+    static bool enabled() noexcept { return WORKER_POOL_TRACE && on.load(std::memory_order_relaxed); }
+
+    /** Record the event of the calling thread, if tracing is on */
+    static void record(TraceEvent event, std::uint64_t arg) noexcept {
+        if (enabled()) { buffer().record(event, arg); }
+    }
+
+    /**
+     * Take ids for the jobs, unique in the process.
+     *
+     * @param n number of ids
+     * @return the first of `n` consecutive ids
+     */
+    static std::uint64_t take_ids(std::uint64_t n) noexcept {
+        return last_id.fetch_add(n, std::memory_order_relaxed) + 1;
+    }
+
+    /** Id of the job the calling thread runs, 0 outside of jobs or if tracing is off */
+    static std::uint64_t running_job() noexcept { return running; }
+
+    /**
+     * Set the job the calling thread runs, see `running_job()`.
+     *
+     * @param job id of the job, 0 when it's over
+     * @return the job run before, to be restored
+     */
+    static std::uint64_t run_job(std::uint64_t job) noexcept { return std::exchange(running, job); }
+
+    /** Name the calling thread in the trace, if tracing is on */
+    static void name_thread(std::string name);
+
+    /**
+     * Write the events of all threads as Chrome trace JSON.
+     * May be called while the threads record.
+     */
+    static void dump(std::ostream& out);
+
+    /**
+     * Write the trace into the file, replacing it.
+     *
+     * @throw std::system_error if the file can't be written
+     */
+    static void dump(const std::string& path);
+
+    /**
+     * Dump the trace into the file every time the signal comes, from a
+     * thread of its own. Blocks the signal in the calling thread, so call
+     * it before starting other threads: they inherit the mask and the
+     * signal gets only to the dumping thread.
+     *
+     * @throw std::system_error if the signal can't be blocked
+     */
+    static void dump_on_signal(int signal, std::string path);
+};
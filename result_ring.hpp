@@ -0,0 +1,252 @@
+/**
+ * @file result_ring.hpp
+ * @author Albert Kharisov <albkharisov@gmail.com>
+ * @version 1.0
+ *
+ * @brief Bounded ring of results completed out of order
+ * and consumed in order.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+
+/** Size of the cache line to keep independently written data apart */
+inline constexpr std::size_t cache_line_size = 64;
+
+/**
+ * @brief Ordered results ring.
+ *
+ * Every result gets a sequence number in `reserve()`, is written to its
+ * preallocated slot by any thread in `publish()` and is taken by the
+ * single consumer in `consume()` strictly in the sequence order.
+ * Nothing is allocated per result. A slot may get an exception
+ * instead of the result, the consumer rethrows it.
+ *
+ * Writers and the consumer don't share any lock. Mutex and condvars
+ * are only touched when somebody has to sleep: the consumer waiting
+ * for the next result or a producer waiting for a free slot.
+ *
+ * @tparam T type of the results
+ */
+template <typename T>
+class ResultRing {
+    /** Storage of one result */
+    struct alignas(cache_line_size) Slot {
+        /**
+         * State of the slot. For sequence number `s`:
+         * `s` - free to write,
+         * `s + 1` - result is ready,
+         * `s + capacity` - consumed, free for the next lap.
+         */
+        std::atomic<std::uint64_t> seq;
+        /** The result */
+        std::optional<T> value;
+        /** Exception published instead of the result */
+        std::exception_ptr error;
+        /** Tag published with the result */
+        std::uint64_t tag = 0;
+    };
+
+    /** Number of slots, power of 2 */
+    const std::size_t capacity;
+    /** Slots storage */
+    std::unique_ptr<Slot[]> slots;
+
+    /** Next sequence number to reserve. Producers side */
+    alignas(cache_line_size) std::atomic<std::uint64_t> head{0};
+    /** Next sequence number to consume. Consumer side */
+    alignas(cache_line_size) std::atomic<std::uint64_t> tail{0};
+    /** Tag of the result consumed last. Consumer side */
+    std::uint64_t consumed_tag = 0;
+
+    /** Mutex for sleeping only */
+    alignas(cache_line_size) std::mutex m;
+    /** Condvar for the consumer, waiting for the result */
+    std::condition_variable cv_ready;
+    /** Condvar for the producers, waiting for the free slot */
+    std::condition_variable cv_space;
+    /** Consumer is sleeping on `cv_ready` */
+    std::atomic<bool> consumer_waiting{false};
+    /** Number of producers sleeping on `cv_space` */
+    std::atomic<unsigned> producers_waiting{0};
+    /** No more results will be reserved */
+    std::atomic<bool> closed{false};
+
+    /** Number of attempts to find next result ready before sleeping */
+    static constexpr int spin_count = 64;
+
+    /** Round up to power of 2 */
+    static std::size_t round_up(std::size_t n) {
+        std::size_t p = 1;
+        while (p < n) { p <<= 1; }
+        return p;
+    }
+
+    /** Slot for the sequence number */
+    Slot& slot(std::uint64_t seq) { return slots[seq & (capacity - 1)]; }
+
+public:
+    /**
+     * A constructor.
+     *
+     * @param size maximum number of results in flight, \
+     *  rounded up to power of 2, at least 2: with a single slot
+     *  "ready for `s`" and "free for `s + 1`" would be the same state
+     */
+    explicit ResultRing(std::size_t size)
+            : capacity(round_up(std::max<std::size_t>(size, 2))),
+              slots(std::make_unique<Slot[]>(capacity)) {
+        for (std::size_t i = 0; i < capacity; ++i) {
+            slots[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    /** Check if `reserve()` would block now */
+    bool full() const { return head.load() - tail.load() >= capacity; }
+
+    /**
+     * Reserve a slot for the next result. Blocks while the ring is full,
+     * i.e. until the consumer takes the result `capacity` places ahead.
+     *
+     * @return sequence number to publish the result with
+     */
+    std::uint64_t reserve() {
+        const auto seq = head.fetch_add(1);
+        auto& s = slot(seq);
+        if (s.seq.load(std::memory_order_acquire) != seq) {
+            std::unique_lock<std::mutex> l(m);
+            producers_waiting.fetch_add(1);
+            cv_space.wait(l, [&s, seq] { return s.seq.load() == seq; });
+            producers_waiting.fetch_sub(1);
+        }
+        return seq;
+    }
+
+    /**
+     * Reserve a slot for the next result if there is a free one, never blocks.
+     *
+     * @return sequence number to publish the result with, \
+     *  empty if the ring is full
+     */
+    std::optional<std::uint64_t> try_reserve() {
+        auto seq = head.load();
+        do {
+            // the consumer frees the slot before moving the tail past it
+            if (seq - tail.load() >= capacity) { return {}; }
+        } while (!head.compare_exchange_weak(seq, seq + 1));
+        return seq;
+    }
+
+    /**
+     * Store the result.
+     *
+     * @param seq sequence number from `reserve()`
+     * @param value the result
+     * @param tag number to pass to the consumer with it, see `tag()`
+     */
+    void publish(std::uint64_t seq, T&& value, std::uint64_t tag = 0) {
+        slot(seq).value.emplace(std::move(value));
+        slot(seq).tag = tag;
+        mark_ready(seq);
+    }
+
+    /**
+     * Store the exception instead of the result.
+     *
+     * @param seq sequence number from `reserve()`
+     * @param error exception `consume()` rethrows
+     * @param tag number to pass to the consumer with it, see `tag()`
+     */
+    void fail(std::uint64_t seq, std::exception_ptr error, std::uint64_t tag = 0) {
+        slot(seq).error = std::move(error);
+        slot(seq).tag = tag;
+        mark_ready(seq);
+    }
+
+    /**
+     * Take the next result in sequence order. Blocking.
+     * Only one thread may consume.
+     *
+     * @return the result or an empty optional if the ring is closed \
+     *  and all reserved results are consumed
+     * @throw the exception published instead of the result
+     */
+    std::optional<T> consume() {
+        const auto seq = tail.load(std::memory_order_relaxed);
+        auto& s = slot(seq);
+        auto ready = [&s, seq] { return s.seq.load() == seq + 1; };
+
+        bool got = ready();
+        for (int i = 0; !got && i < spin_count; ++i) {
+            std::this_thread::yield();
+            got = ready();
+        }
+        if (!got) {
+            std::unique_lock<std::mutex> l(m);
+            consumer_waiting.store(true);
+            cv_ready.wait(l, [&] { return ready() || (closed.load() && head.load() == seq); });
+            consumer_waiting.store(false);
+            if (!ready()) { return {}; }
+        }
+
+        std::optional<T> result(std::move(s.value));
+        auto error = std::move(s.error);
+        consumed_tag = s.tag;
+        s.value.reset();
+        s.error = nullptr;
+        // pairs with the producer going to sleep, same as in `mark_ready()`
+        s.seq.store(seq + capacity);
+        tail.store(seq + 1);
+
+        if (producers_waiting.load() > 0) {
+            { std::lock_guard<std::mutex> l(m); }
+            cv_space.notify_all();
+        }
+        if (error) { std::rethrow_exception(error); }
+        return result;
+    }
+
+    /** Tag of the result (or the exception) `consume()` took last. Consumer side */
+    std::uint64_t tag() const { return consumed_tag; }
+
+    /** Check if the next result is ready, `consume()` won't block. Consumer side */
+    bool next_ready() {
+        const auto seq = tail.load(std::memory_order_relaxed);
+        return slot(seq).seq.load(std::memory_order_acquire) == seq + 1;
+    }
+
+    /** Check if the next result is an exception, only after `next_ready()`. Consumer side */
+    bool next_failed() { return static_cast<bool>(slot(tail.load(std::memory_order_relaxed)).error); }
+
+    /** Tell the consumer no more results are coming after reserved ones */
+    void close() {
+        {
+            std::lock_guard<std::mutex> l(m);
+            closed.store(true);
+        }
+        cv_ready.notify_all();
+    }
+
+private:
+    /** Mark the slot ready and wake the consumer */
+    void mark_ready(std::uint64_t seq) {
+        auto& s = slot(seq);
+        // Pairs with the consumer going to sleep: either we see it
+        // waiting or it sees the result is ready.
+        s.seq.store(seq + 1);
+        if (consumer_waiting.load()) {
+            { std::lock_guard<std::mutex> l(m); }
+            cv_ready.notify_one();
+        }
+    }
+};
@@ -0,0 +1,127 @@
+/**
+ * @file ring_test.cpp
+ * @author Albert Kharisov <albkharisov@gmail.com>
+ * @version 1.0
+ *
+ * @brief Checks of the smallest rings of the worker pool.
+ *
+ * Runs the ring of results, the lock-free queue of jobs and the pool
+ * over them with a single slot asked for, where a slot freed for the
+ * next lap looked the same as a result ready. Run by ctest: exits with
+ * failure if any of the results is not the expected one, hangs (and
+ * times out) if a ring loses track.
+ */
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <tuple>
+#include <vector>
+#include "mpmc_queue.hpp"
+#include "result_ring.hpp"
+#include "worker_pool.hpp"
+
+namespace {
+
+/** Number of failed checks */
+int failures = 0;
+
+/** Account the check, printing it */
+void check(bool ok, const char* what) {
+    std::cout << (ok ? "ok     " : "FAILED ") << what << std::endl;
+    if (!ok) { ++failures; }
+}
+
+/** Job answering its argument */
+std::string echo(int x) { return std::to_string(x); }
+
+/** Take `n` answers of the pool in Completion::batched mode */
+std::vector<std::string> take(WorkerPool& pool, std::size_t n) {
+    std::vector<std::string> out;
+    while (out.size() < n && pool.get_answers(out)) {}
+    return out;
+}
+
+} // namespace
+
+
+/**
+ * @brief Entry point function
+ *
+ * @return EXIT_SUCCESS if all the checks passed
+ */
+int main() {
+    {
+        ResultRing<int> ring(1);
+        const auto first = ring.reserve();
+        ring.publish(first, 1);
+        check(!ring.full(), "ring of 1 still has a slot for the second result");
+        const auto second = ring.reserve();
+        ring.publish(second, 2);
+        const auto a = ring.consume();
+        const auto b = ring.consume();
+        check(a == 1 && b == 2, "ring of 1 gives the results in order");
+    }
+
+    {
+        MpmcQueue<int> queue(1);
+        int a = 0;
+        int b = 0;
+        int c = -1;
+        const bool pushed = queue.try_push(1) && queue.try_push(2);
+        const bool popped = queue.try_pop(a) && queue.try_pop(b);
+        check(pushed && popped && a == 1 && b == 2 && !queue.try_pop(c), "queue of 1 takes two elements in order");
+    }
+
+    WorkerPoolOptions options;
+    options.verbose = false;
+    options.ring_size = 1;
+
+    {
+        options.completion = Completion::ring;
+        WorkerPool pool(2, options);
+        pool.set_job(echo, 1);
+        pool.wait_idle();
+        pool.set_job(echo, 2);
+        const auto a = pool.get_answer();
+        const auto b = pool.get_answer();
+        check(a == "1" && b == "2", "ring mode with ring_size 1");
+    }
+
+    {
+        options.completion = Completion::ring;
+        WorkerPool pool(2, options);
+        const bool set = pool.try_set_job(echo, 1) && pool.try_set_job(echo, 2);
+        // the ring of 2 holds both answers until they are taken
+        const bool refused = !pool.try_set_job(echo, 3);
+        const auto a = pool.get_answer();
+        const auto b = pool.get_answer();
+        check(set && refused && a == "1" && b == "2", "try_set_job() refuses the full ring instead of waiting");
+    }
+
+    {
+        options.completion = Completion::batched;
+        WorkerPool pool(2, options);
+        const std::vector<std::tuple<int>> first{{1}, {2}};
+        const std::vector<std::tuple<int>> second{{3}};
+        pool.set_jobs(echo, first.begin(), first.end());
+        pool.wait_idle();
+        pool.set_jobs(echo, second.begin(), second.end());
+        check(take(pool, 3) == std::vector<std::string>{"1", "2", "3"}, "batched mode with ring_size 1");
+    }
+
+    {
+        options.completion = Completion::ring;
+        options.scheduling = Scheduling::lock_free;
+        options.lock_free_size = 1;
+        // all the answers stay in flight until the loop below takes them
+        options.ring_size = 128;
+        WorkerPool pool(2, options);
+        for (int i = 0; i < 100; ++i) { pool.set_job(echo, i); }
+        bool in_order = true;
+        for (int i = 0; i < 100; ++i) { in_order = in_order && pool.get_answer() == std::to_string(i); }
+        check(in_order, "lock-free scheduling with lock_free_size 1");
+    }
+
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,270 @@
+/**
+ * @file slab_allocator.hpp
+ * @author Albert Kharisov <albkharisov@gmail.com>
+ * @version 1.0
+ *
+ * @brief Thread caching recycler of objects and slab allocator on top of it.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <vector>
+
+/**
+ * @brief Thread caching recycler of objects.
+ *
+ * Every thread keeps its own cache, so recycling doesn't lock in the
+ * common case. Objects released on one thread (a consumer) and acquired
+ * on another (a producer) travel through a shared depot in batches,
+ * one lock per batch.
+ *
+ * @tparam T type of recycled objects
+ * @tparam Tag lets different users recycle the same type separately
+ */
+template <typename T, typename Tag = void>
+class Recycler {
+    /** Number of objects moved to or from the depot at once */
+    static constexpr std::size_t batch = 64;
+
+    /** Batches shared by all threads */
+    struct Depot {
+        /** Mutex for batches */
+        std::mutex m;
+        /** Full batches */
+        std::vector<std::vector<T>> batches;
+    };
+
+    /** Objects of the current thread */
+    struct Cache {
+        /** Cached objects */
+        std::vector<T> items;
+        /** A destructor. Leaves the objects to the other threads */
+        ~Cache() {
+            if (items.empty()) { return; }
+            auto& d = depot();
+            std::lock_guard<std::mutex> l(d.m);
+            d.batches.push_back(std::move(items));
+        }
+    };
+
+    /** The depot */
+    static Depot& depot() {
+        static Depot d;
+        return d;
+    }
+
+    /** Cache of the current thread */
+    static Cache& cache() {
+        static thread_local Cache c;
+        return c;
+    }
+
+public:
+    /**
+     * Take a recycled object.
+     *
+     * @param out where to move the object
+     * @return false if there is none
+     */
+    static bool acquire(T& out) {
+        auto& items = cache().items;
+        if (items.empty()) {
+            auto& d = depot();
+            std::lock_guard<std::mutex> l(d.m);
+            if (d.batches.empty()) { return false; }
+            items = std::move(d.batches.back());
+            d.batches.pop_back();
+        }
+        out = std::move(items.back());
+        items.pop_back();
+        return true;
+    }
+
+    /** Give the object for reuse */
+    static void release(T&& item) {
+        auto& items = cache().items;
+        items.push_back(std::move(item));
+        if (items.size() < 2 * batch) { return; }
+
+        // keep a batch for ourselves, share the other one
+        std::vector<T> full(std::make_move_iterator(items.end() - batch), std::make_move_iterator(items.end()));
+        items.resize(items.size() - batch);
+        auto& d = depot();
+        std::lock_guard<std::mutex> l(d.m);
+        d.batches.push_back(std::move(full));
+    }
+};
+
+/**
+ * @brief Allocator of fixed size blocks.
+ *
+ * Blocks are cut from chunks allocated at once. Freed blocks are linked
+ * through their own bytes into a list of the thread and move between
+ * threads in batches through a shared depot, the same way as in the
+ * Recycler, so a block may be freed on any thread and freeing never
+ * allocates. Chunks are kept until the program exits, memory of the
+ * peak load stays allocated.
+ *
+ * @tparam Size size of the blocks
+ */
+template <std::size_t Size>
+class SlabAllocator {
+    /** Storage of one block */
+    struct alignas(std::max_align_t) Block {
+        /** Bytes of the block */
+        unsigned char bytes[Size];
+    };
+
+    /** Freed block, written over its bytes */
+    struct FreeBlock {
+        /** Next block of the list */
+        FreeBlock* next;
+        /** Next list of the depot, set in the first block of a list */
+        FreeBlock* next_list;
+        /** Number of blocks of the list, set in the first block of a list */
+        std::size_t size;
+    };
+    static_assert(sizeof(FreeBlock) <= sizeof(Block), "a freed block has to fit its links");
+
+    /** Number of blocks in a chunk */
+    static constexpr std::size_t chunk_blocks = 64;
+    /** Number of blocks moved to or from the depot at once */
+    static constexpr std::size_t batch = 64;
+
+    /** Lists of blocks shared by all threads */
+    struct Depot {
+        /** Mutex for the lists */
+        std::mutex m;
+        /** First list, the others are linked through `next_list` */
+        FreeBlock* lists = nullptr;
+
+        /** Add the list, `m` has to be locked */
+        void push(FreeBlock* list, std::size_t size) noexcept {
+            list->size = size;
+            list->next_list = lists;
+            lists = list;
+        }
+    };
+
+    /** Blocks of the current thread */
+    struct Cache {
+        /** First block */
+        FreeBlock* head = nullptr;
+        /** Number of blocks */
+        std::size_t size = 0;
+        /** A destructor. Leaves the blocks to the other threads */
+        ~Cache() {
+            if (!head) { return; }
+            auto& d = depot();
+            std::lock_guard<std::mutex> l(d.m);
+            d.push(head, size);
+        }
+    };
+
+    /** All chunks ever allocated */
+    struct Chunks {
+        /** Mutex for chunks */
+        std::mutex m;
+        /** The chunks */
+        std::vector<std::unique_ptr<Block[]>> chunks;
+    };
+
+    /** The depot */
+    static Depot& depot() {
+        static Depot d;
+        return d;
+    }
+
+    /** Cache of the current thread */
+    static Cache& cache() {
+        static thread_local Cache c;
+        return c;
+    }
+
+    /** The chunks */
+    static Chunks& chunks() {
+        static Chunks c;
+        return c;
+    }
+
+    /** Put the block to the list of the thread, share a batch when there are two */
+    static void release(void* ptr) noexcept {
+        auto& c = cache();
+        c.head = new (ptr) FreeBlock{c.head, nullptr, 0};
+        if (++c.size < 2 * batch) { return; }
+
+        // keep the batch freed last, it's the warmest, share the other one
+        auto* last = c.head;
+        for (std::size_t i = 1; i < batch; ++i) { last = last->next; }
+        auto* shared = last->next;
+        last->next = nullptr;
+        c.size = batch;
+        auto& d = depot();
+        // std::mutex::lock() only throws when the system runs out of resources
+        std::lock_guard<std::mutex> l(d.m);
+        d.push(shared, batch);
+    }
+
+public:
+    /** Allocate a block of `Size` bytes */
+    static void* allocate() {
+        auto& c = cache();
+        if (!c.head) {
+            auto& d = depot();
+            std::lock_guard<std::mutex> l(d.m);
+            if (d.lists) {
+                c.head = d.lists;
+                c.size = c.head->size;
+                d.lists = c.head->next_list;
+            }
+        }
+        if (c.head) {
+            auto* block = c.head;
+            c.head = block->next;
+            --c.size;
+            return block;
+        }
+
+        std::unique_ptr<Block[]> chunk(new Block[chunk_blocks]);
+        Block* block = chunk.get();
+        {
+            auto& cs = chunks();
+            std::lock_guard<std::mutex> l(cs.m);
+            cs.chunks.push_back(std::move(chunk));
+        }
+        for (std::size_t i = 1; i < chunk_blocks; ++i) { release(&block[i]); }
+        return block;
+    }
+
+    /** Free the block */
+    static void deallocate(void* ptr) noexcept { release(ptr); }
+};
+
+/**
+ * @brief Allocate memory for an object, small ones come from slabs.
+ *
+ * @param size size of the object, has to be passed to `slab_deallocate()`
+ */
+inline void* slab_allocate(std::size_t size) {
+    if (size <= 64) { return SlabAllocator<64>::allocate(); }
+    if (size <= 128) { return SlabAllocator<128>::allocate(); }
+    if (size <= 256) { return SlabAllocator<256>::allocate(); }
+    return ::operator new(size);
+}
+
+/**
+ * @brief Free memory allocated with `slab_allocate()`.
+ *
+ * @param size the same size it was allocated with
+ */
+inline void slab_deallocate(void* ptr, std::size_t size) noexcept {
+    if (size <= 64) { return SlabAllocator<64>::deallocate(ptr); }
+    if (size <= 128) { return SlabAllocator<128>::deallocate(ptr); }
+    if (size <= 256) { return SlabAllocator<256>::deallocate(ptr); }
+    ::operator delete(ptr, size);
+}
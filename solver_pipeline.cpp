@@ -0,0 +1,137 @@
+/**
+ * @file solver_pipeline.cpp
+ * @author Albert Kharisov <albkharisov@gmail.com>
+ * @version 1.0
+ *
+ * @brief Equations solved in stages on the worker pool.
+ */
+
+#include <chrono>
+#include <ostream>
+#include "solver_pipeline.hpp"
+
+
+namespace {
+
+/** Name of the stage */
+const char* name(Stage stage) {
+    switch (stage) {
+    case Stage::parse: return "parse";
+    case Stage::solve: return "solve";
+    case Stage::format: return "format";
+    }
+    return "?";
+}
+
+} // namespace
+
+
+StageGroups parse_stage_groups(std::string_view spec) {
+    StageGroups groups(1);
+    std::size_t next = 0;
+    while (!spec.empty()) {
+        const auto end = spec.find_first_of(",+");
+        const auto word = spec.substr(0, end);
+        if (next == stage_count || word != name(static_cast<Stage>(next))) { return {}; }
+        groups.back().push_back(static_cast<Stage>(next++));
+
+        if (end == std::string_view::npos) { break; }
+        if (spec[end] == ',') { groups.emplace_back(); }
+        spec.remove_prefix(end + 1);
+    }
+    if (next != stage_count || groups.back().empty()) { return {}; }
+    return groups;
+}
+
+void EquationBatch::add(const InputBlockPtr& block, const std::array<std::string_view, 3>& coefs) {
+    // records of a block come one after another
+    if (blocks.empty() || blocks.back() != block) { blocks.push_back(block); }
+    fields.push_back(coefs);
+}
+
+void EquationBatch::run(Stage stage, AnswerCache* cache) {
+    const auto n = size();
+    switch (stage) {
+    case Stage::parse:
+        status.resize(n);
+        a.resize(n);
+        b.resize(n);
+        c.resize(n);
+        for (std::size_t i = 0; i < n; ++i) {
+            const auto& f = fields[i];
+            status[i] = parse_coefficients(f[0], f[1], f[2], a[i], b[i], c[i]);
+            // invalid equations are solved along with the others, but not printed
+            if (status[i] != ParseStatus::ok) { a[i] = b[i] = c[i] = 0; }
+        }
+        break;
+
+    case Stage::solve:
+        roots.resize(n);
+        solve_square_equations(a.data(), b.data(), c.data(), n, roots.data());
+        break;
+
+    case Stage::format: {
+        std::size_t total = 0;
+        for (const auto& f : fields) { total += answer_size(f[0], f[1], f[2]) + 1; }
+        text = WorkerPool::answer_buffer();
+        text.resize(total);
+
+        char* p = text.data();
+        for (std::size_t i = 0; i < n; ++i) {
+            const auto& f = fields[i];
+            if (i) { *p++ = '\n'; }
+            if (cache && status[i] == ParseStatus::ok) {
+                p += format_echo(f[0], f[1], f[2], p);
+                p += cache->write_roots(a[i], b[i], c[i], roots[i], p);
+            } else {
+                p += format_answer(f[0], f[1], f[2], status[i], roots[i], p);
+            }
+        }
+        text.resize(p - text.data());
+        break;
+    }
+    }
+}
+
+void SolverPipeline::submit(std::unique_ptr<EquationBatch> batch) {
+    auto answer = pool.reserve_answer();
+    pool.post([this, batch = std::move(batch), answer = std::move(answer)]() mutable {
+        run(0, std::move(batch), std::move(answer));
+    });
+}
+
+void SolverPipeline::run(std::size_t group, std::unique_ptr<EquationBatch> batch,
+                         WorkerPool::PendingAnswer answer) {
+    try {
+        for (auto stage : groups[group]) {
+            const auto start = std::chrono::steady_clock::now();
+            batch->run(stage, cache);
+            const auto spent = std::chrono::steady_clock::now() - start;
+            busy[static_cast<std::size_t>(stage)].fetch_add(
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(spent).count(), std::memory_order_relaxed);
+        }
+    } catch (...) {
+        // posted jobs must not throw, the consumer gets it instead of the answers
+        answer.fail(std::current_exception());
+        return;
+    }
+
+    if (group + 1 == groups.size()) {
+        answer.deliver(std::move(batch->text));
+        return;
+    }
+    // batches in flight go before the new ones, so they don't pile up
+    pool.post(Priority::high, [this, group, batch = std::move(batch), answer = std::move(answer)]() mutable {
+        run(group + 1, std::move(batch), std::move(answer));
+    });
+}
+
+std::ostream& operator<<(std::ostream& out, const SolverPipeline& pipeline) {
+    using ms = std::chrono::duration<double, std::milli>;
+    out << "pipeline:";
+    for (std::size_t s = 0; s < stage_count; ++s) {
+        out << (s ? ", " : " ") << name(static_cast<Stage>(s)) << " "
+            << ms(std::chrono::nanoseconds(pipeline.busy[s].load())).count() << "ms";
+    }
+    return out << std::endl;
+}
@@ -0,0 +1,146 @@
+/**
+ * @file solver_pipeline.hpp
+ * @author Albert Kharisov <albkharisov@gmail.com>
+ * @version 1.0
+ *
+ * @brief Equations solved in stages on the worker pool.
+ *
+ * A batch of equations goes through parsing into dense arrays of ints,
+ * solving the arrays at once (see `solve_square_equations()`) and
+ * formatting the answers. Stages may run as separate jobs or be fused
+ * into one, time spent in each of them is counted.
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "answer_cache.hpp"
+#include "input_reader.hpp"
+#include "square_solver.hpp"
+#include "worker_pool.hpp"
+
+/**
+ * @brief Stage of solving a batch of equations.
+ */
+enum class Stage {
+    /** Coefficients are parsed into ints */
+    parse,
+    /** Equations are solved */
+    solve,
+    /** Answers are formatted */
+    format,
+};
+
+/** Number of stages */
+inline constexpr std::size_t stage_count = 3;
+
+/**
+ * @brief Stages run by every job, in order.
+ */
+using StageGroups = std::vector<std::vector<Stage>>;
+
+/**
+ * @brief Parse the stages of the jobs.
+ *
+ * Jobs are separated by commas, stages of one job by pluses:
+ * "parse,solve,format" runs every stage as a separate job,
+ * "parse+solve+format" runs all of them in one job.
+ *
+ * @param spec description of the jobs
+ * @return stages of the jobs, empty if the stages are not all there in order
+ */
+StageGroups parse_stage_groups(std::string_view spec);
+
+/**
+ * @brief Equations of one batch, structure of arrays.
+ */
+struct EquationBatch {
+    /** Input blocks the coefficients point into */
+    std::vector<InputBlockPtr> blocks;
+    /** Coefficients as they were read, echoed in the answers */
+    std::vector<std::array<std::string_view, 3>> fields;
+    /** Parsing status of every equation */
+    std::vector<ParseStatus> status;
+    /** Parameters a, zero if parsing failed */
+    std::vector<int> a;
+    /** Parameters b, zero if parsing failed */
+    std::vector<int> b;
+    /** Parameters c, zero if parsing failed */
+    std::vector<int> c;
+    /** Solutions */
+    std::vector<Roots> roots;
+    /** Answers, one per line */
+    WorkerPool::Answer text;
+
+    /**
+     * Add the equation.
+     *
+     * @param block input block the coefficients point into
+     * @param coefs coefficients as they were read
+     */
+    void add(const InputBlockPtr& block, const std::array<std::string_view, 3>& coefs);
+
+    /** Number of equations */
+    std::size_t size() const { return fields.size(); }
+
+    /**
+     * Run the stage over all equations.
+     *
+     * @param stage the stage
+     * @param cache formatted roots to reuse, may be null
+     */
+    void run(Stage stage, AnswerCache* cache = nullptr);
+};
+
+/**
+ * @brief Batches of equations solved in stages on the worker pool.
+ *
+ * Every batch gets its place among the answers of the pool when it's
+ * submitted, the last stage delivers the answers of the whole batch
+ * as one, lines separated by '\n'. So answers stay in the input order.
+ * A stage throwing goes to `WorkerPool::get_answer()` in place of the answers.
+ */
+class SolverPipeline {
+    /** Pool running the stages */
+    WorkerPool& pool;
+    /** Stages of every job */
+    const StageGroups groups;
+    /** Formatted roots to reuse, may be null */
+    AnswerCache* const cache;
+    /** Nanoseconds spent in every stage */
+    std::array<std::atomic<std::uint64_t>, stage_count> busy{};
+
+    /**
+     * Run the stages of the job and pass the batch on.
+     *
+     * @param group index of the job in `groups`
+     * @param batch the equations
+     * @param answer place of the answers of the batch
+     */
+    void run(std::size_t group, std::unique_ptr<EquationBatch> batch, WorkerPool::PendingAnswer answer);
+
+public:
+    /**
+     * A constructor.
+     *
+     * @param workers pool running the stages
+     * @param stages stages of every job, see `parse_stage_groups()`
+     * @param answers formatted roots to reuse, may be null
+     */
+    SolverPipeline(WorkerPool& workers, StageGroups stages, AnswerCache* answers = nullptr)
+            : pool(workers), groups(std::move(stages)), cache(answers) {}
+
+    /** Start solving the batch, its answers go to `WorkerPool::get_answer()` */
+    void submit(std::unique_ptr<EquationBatch> batch);
+
+    /** Print time spent in every stage */
+    friend std::ostream& operator<<(std::ostream& out, const SolverPipeline& pipeline);
+};
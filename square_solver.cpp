@@ -6,72 +6,183 @@
  * @brief Square equations solver functions
  */
 
-#include <stdexcept>
+#include <charconv>
 #include <cmath>
+#include <cstring>
 #include "square_solver.hpp"
 
 
-std::string calculate_square_roots(std::string a_str, std::string b_str, std::string c_str) {
-    std::string answer;
-    answer.resize(a_str.size() + b_str.size() + c_str.size() + 10);
-    auto size = std::snprintf(answer.data(), answer.size(), "(%s %s %s) => ", a_str.c_str(), b_str.c_str(), c_str.c_str());
-    answer.resize(size);
+namespace {
 
-    char format_buf[30];
-    int a, b, c;
+/** Longest `%.6g` of a double: sign, 6 digits, dot and exponent */
+constexpr std::size_t number_size = 16;
+
+/**
+ * Appender into the fixed buffer.
+ * Space is checked by the caller.
+ */
+struct Writer {
+    /** Position to write next */
+    char* p;
+
+    /** Append chars */
+    Writer& operator<<(std::string_view s) {
+        std::memcpy(p, s.data(), s.size());
+        p += s.size();
+        return *this;
+    }
 
-    try {
-        a = std::stoi(a_str);
-        b = std::stoi(b_str);
-        c = std::stoi(c_str);
-    } catch (std::invalid_argument&) {
-        return answer.append("invalid argument");
-    } catch (std::out_of_range&) {
-        return answer.append("out of range");
+    /** Append a number as `%.6g` does */
+    Writer& operator<<(double num) {
+        p = std::to_chars(p, p + number_size, num, std::chars_format::general, 6).ptr;
+        return *this;
     }
+};
 
+} // namespace
+
+
+int negate_coefficient(int b) noexcept {
+    return static_cast<int>(0u - static_cast<unsigned>(b));
+}
+
+ParseStatus parse_coefficient(std::string_view str, int& value) noexcept {
+    const char* first = str.data();
+    const char* last = first + str.size();
+
+    // std::stoi skips spaces and accepts '+', std::from_chars doesn't
+    while (first != last && (*first == ' ' || (*first >= '\t' && *first <= '\r'))) { ++first; }
+    if (first != last && *first == '+') {
+        ++first;
+        if (first == last || *first < '0' || *first > '9') {
+            return ParseStatus::invalid_argument;
+        }
+    }
+
+    auto [ptr, ec] = std::from_chars(first, last, value);
+    if (ec == std::errc::invalid_argument) { return ParseStatus::invalid_argument; }
+    if (ec == std::errc::result_out_of_range) { return ParseStatus::out_of_range; }
+    return ParseStatus::ok;
+}
+
+Roots solve_square_equation(int a, int b, int c) noexcept {
     const double epsilon = 1e-7;
-    auto decorate_float = [epsilon](double num) -> double {
-        return (std::abs(num) < epsilon) ? 0 : num;
-    };
+    Roots roots{};
 
     if (a == 0) {
         // linear equation
         if (b == 0) {
             // any X is a solution of equation
-            answer.append("(x ∈ R)");
+            roots.kind = RootsKind::any;
         } else if (c == 0) {
-            answer.append("(0)");
+            roots.kind = RootsKind::one;
+            roots.x1 = 0;
         } else {
-            auto x = static_cast<double>(b) / c;
-            std::snprintf(format_buf, sizeof(format_buf), "(%.6g)", decorate_float(x));
-            answer.append(format_buf);
+            roots.kind = RootsKind::one;
+            roots.x1 = static_cast<double>(b) / c;
         }
+        return roots;
+    }
+
+    // square equation
+    // epsilon is here to fix precision loss during floating point operations
+    double d = static_cast<double>(b) * b - 4. * a * c;
+    if (d < -epsilon) {
+        roots.kind = RootsKind::none;
+    } else if (std::abs(d) < epsilon) {
+        roots.kind = RootsKind::one;
+        roots.x1 = static_cast<double>(negate_coefficient(b)) / (2. * a);
     } else {
-        // square equation
-        // epsilon is here to fix precision loss during floating point operations
-        double d = static_cast<double>(b) * b - 4. * a * c;
-        if (d < -epsilon) {
-            answer.append("no roots");
-        } else if (std::abs(d) < epsilon) {
-            double x = static_cast<double>(-b) / (2. * a);
-            std::snprintf(format_buf, sizeof(format_buf), "(%.6g)", decorate_float(x));
-            answer.append(format_buf);
-        } else {
-            auto d_sqrt = std::sqrt(d);
-            int b_sign = b < 0 ? -1 : 1;
-            auto temp = -0.5 * (b + b_sign * d_sqrt);
-            auto x1 = c / temp;
-            auto x2 = temp / a;
-            std::snprintf(format_buf, sizeof(format_buf), "(%.6g %.6g)", decorate_float(x1), decorate_float(x2));
-            answer.append(format_buf);
-        }
+        auto d_sqrt = std::sqrt(d);
+        int b_sign = b < 0 ? -1 : 1;
+        auto temp = -0.5 * (b + b_sign * d_sqrt);
+        roots.kind = RootsKind::two;
+        roots.x1 = c / temp;
+        roots.x2 = temp / a;
+    }
 
-        double x_extremum = static_cast<double>(-b) / (2. * a);
-        std::snprintf(format_buf, sizeof(format_buf), " X%s=%.6g", (a > 0) ? "min" : "max", decorate_float(x_extremum));
-        answer.append(format_buf);
+    roots.has_extremum = true;
+    roots.minimum = a > 0;
+    roots.extremum = static_cast<double>(negate_coefficient(b)) / (2. * a);
+    return roots;
+}
+
+std::size_t format_roots(const Roots& roots, char* buf) noexcept {
+    const double epsilon = 1e-7;
+    auto decorate_float = [epsilon](double num) -> double {
+        return (std::abs(num) < epsilon) ? 0 : num;
+    };
+
+    Writer out{buf};
+    switch (roots.kind) {
+    case RootsKind::any:
+        out << "(x ∈ R)";
+        break;
+    case RootsKind::none:
+        out << "no roots";
+        break;
+    case RootsKind::one:
+        out << "(" << decorate_float(roots.x1) << ")";
+        break;
+    case RootsKind::two:
+        out << "(" << decorate_float(roots.x1) << " " << decorate_float(roots.x2) << ")";
+        break;
     }
 
-    return answer;
+    if (roots.has_extremum) {
+        out << (roots.minimum ? " Xmin=" : " Xmax=") << decorate_float(roots.extremum);
+    }
+    return out.p - buf;
+}
+
+ParseStatus parse_coefficients(std::string_view a_str, std::string_view b_str, std::string_view c_str,
+                               int& a, int& b, int& c) noexcept {
+    auto status = parse_coefficient(a_str, a);
+    if (status == ParseStatus::ok) { status = parse_coefficient(b_str, b); }
+    if (status == ParseStatus::ok) { status = parse_coefficient(c_str, c); }
+    return status;
+}
+
+std::size_t format_echo(std::string_view a_str, std::string_view b_str, std::string_view c_str,
+                        char* buf) noexcept {
+    Writer out{buf};
+    out << "(" << a_str << " " << b_str << " " << c_str << ") => ";
+    return out.p - buf;
 }
 
+std::size_t format_answer(std::string_view a_str, std::string_view b_str, std::string_view c_str,
+                          ParseStatus status, const Roots& roots, char* buf) noexcept {
+    Writer out{buf + format_echo(a_str, b_str, c_str, buf)};
+
+    switch (status) {
+    case ParseStatus::invalid_argument:
+        out << "invalid argument";
+        break;
+    case ParseStatus::out_of_range:
+        out << "out of range";
+        break;
+    case ParseStatus::ok:
+        out.p += format_roots(roots, out.p);
+        break;
+    }
+    return out.p - buf;
+}
+
+WrittenAnswer write_square_roots(std::string_view a_str, std::string_view b_str, std::string_view c_str,
+                                 char* buf, std::size_t size) noexcept {
+    if (size < answer_size(a_str, b_str, c_str)) {
+        return {ParseStatus::ok, 0};
+    }
+
+    int a, b, c;
+    const auto status = parse_coefficients(a_str, b_str, c_str, a, b, c);
+    const auto roots = status == ParseStatus::ok ? solve_square_equation(a, b, c) : Roots{};
+    return {status, format_answer(a_str, b_str, c_str, status, roots, buf)};
+}
+
+std::string calculate_square_roots(std::string_view a_str, std::string_view b_str, std::string_view c_str) {
+    std::string answer;
+    answer.resize(answer_size(a_str, b_str, c_str));
+    answer.resize(write_square_roots(a_str, b_str, c_str, answer.data(), answer.size()).size);
+    return answer;
+}
@@ -8,13 +8,203 @@
 
 #pragma once
 
+#include <cstddef>
 #include <string>
+#include <string_view>
+
+/**
+ * @brief Status of the coefficient parsing.
+ */
+enum class ParseStatus {
+    /** Parsed successfully */
+    ok,
+    /** Not a number */
+    invalid_argument,
+    /** Number doesn't fit into int */
+    out_of_range,
+};
+
+/**
+ * @brief Kind of the equation solution.
+ */
+enum class RootsKind : unsigned char {
+    /** Any X is a solution */
+    any,
+    /** No real roots */
+    none,
+    /** One root in `x1` */
+    one,
+    /** Two roots in `x1` and `x2` */
+    two,
+};
+
+/**
+ * @brief Roots and extremum of the equation.
+ */
+struct Roots {
+    /** Number of roots */
+    RootsKind kind;
+    /** Equation is square (a != 0) and has an extremum */
+    bool has_extremum;
+    /** Extremum is minimum (a > 0) */
+    bool minimum;
+    /** First root */
+    double x1;
+    /** Second root */
+    double x2;
+    /** X of the extremum */
+    double extremum;
+};
+
+/**
+ * @brief Outcome of writing the answer into a buffer.
+ */
+struct WrittenAnswer {
+    /** Status of coefficients parsing */
+    ParseStatus status;
+    /** Number of chars written, 0 if the buffer is too small */
+    std::size_t size;
+};
+
+/** Maximum size of the answer after the coefficients echo */
+inline constexpr std::size_t answer_tail_size = 64;
+
+/**
+ * @brief Buffer size enough for the answer to these coefficients.
+ */
+inline std::size_t answer_size(std::string_view a_str, std::string_view b_str, std::string_view c_str) {
+    return a_str.size() + b_str.size() + c_str.size() + 8 + answer_tail_size;
+}
+
+/**
+ * @brief Parse integer coefficient.
+ *
+ * Accepts the same input as std::stoi does: leading spaces,
+ * optional sign and digits up to the first non-digit char.
+ * Doesn't throw.
+ *
+ * @param str string to parse
+ * @param value where to put the result
+ * @return status of parsing, `value` is valid only for ParseStatus::ok
+ */
+ParseStatus parse_coefficient(std::string_view str, int& value) noexcept;
+
+/**
+ * @brief Parse three coefficients, stops at the first failure.
+ *
+ * @return status of parsing, coefficients are valid only for ParseStatus::ok
+ */
+ParseStatus parse_coefficients(std::string_view a_str, std::string_view b_str, std::string_view c_str,
+                               int& a, int& b, int& c) noexcept;
+
+/**
+ * @brief Negate coefficient, -INT_MIN wraps to INT_MIN.
+ *
+ * Same as `-b` always evaluated to in the answers,
+ * but without undefined behavior, so vector code can match it.
+ */
+int negate_coefficient(int b) noexcept;
+
+/**
+ * @brief Solve the equation a*x^2 + b*x + c = 0.
+ *
+ * If a == 0, solve as a linear equation (no extremum provided).
+ *
+ * @return roots and extremum
+ */
+Roots solve_square_equation(int a, int b, int c) noexcept;
+
+/**
+ * @brief Instruction set used to solve equations in batches.
+ */
+enum class SimdLevel {
+    /** One equation at a time */
+    scalar,
+    /** 4 equations at a time */
+    avx2,
+    /** 8 equations at a time */
+    avx512,
+};
+
+/**
+ * @brief Best instruction set supported by this CPU.
+ */
+SimdLevel simd_level() noexcept;
+
+/**
+ * @brief Solve many equations a[i]*x^2 + b[i]*x + c[i] = 0 at once.
+ *
+ * Coefficients are passed as structure of arrays, so they can be loaded
+ * into vector registers directly. Results are identical to calling
+ * `solve_square_equation()` for each equation.
+ *
+ * @param a parameters a of the equations
+ * @param b parameters b of the equations
+ * @param c parameters c of the equations
+ * @param n number of equations
+ * @param roots where to put `n` solutions
+ * @param level instruction set to use, has to be supported by the CPU
+ */
+void solve_square_equations(const int* a, const int* b, const int* c, std::size_t n,
+                            Roots* roots, SimdLevel level = simd_level()) noexcept;
+
+/**
+ * @brief Format roots and extremum the way `calculate_square_roots()` does.
+ *
+ * @param roots roots to format
+ * @param buf where to write, has to fit `answer_tail_size` chars
+ * @return number of chars written
+ */
+std::size_t format_roots(const Roots& roots, char* buf) noexcept;
+
+/**
+ * @brief Format the coefficients echo the answer starts with: "(a b c) => ".
+ *
+ * @param buf where to write, has to fit `answer_size() - answer_tail_size` chars
+ * @return number of chars written
+ */
+std::size_t format_echo(std::string_view a_str, std::string_view b_str, std::string_view c_str,
+                        char* buf) noexcept;
+
+/**
+ * @brief Format the answer: the coefficients echo and the roots
+ * or the parsing error.
+ *
+ * @param a_str parameter a as it was read
+ * @param b_str parameter b as it was read
+ * @param c_str parameter c as it was read
+ * @param status status of parsing the coefficients
+ * @param roots solution, used only for ParseStatus::ok
+ * @param buf where to write, has to fit `answer_size()` chars
+ * @return number of chars written
+ */
+std::size_t format_answer(std::string_view a_str, std::string_view b_str, std::string_view c_str,
+                          ParseStatus status, const Roots& roots, char* buf) noexcept;
+
+/**
+ * @brief Calculate square roots and extremum (if so)
+ * and write an answer into the buffer.
+ *
+ * Same answer as `calculate_square_roots()` returns, but nothing
+ * is allocated and no exceptions are thrown for the invalid input.
+ *
+ * @param a_str parameter a in quadratic equation
+ * @param b_str parameter b in quadratic equation
+ * @param c_str parameter c in quadratic equation
+ * @param buf where to write the answer
+ * @param size size of the buffer, `answer_size()` is always enough
+ *
+ * @return status of parsing and size of the answer
+ */
+WrittenAnswer write_square_roots(std::string_view a_str, std::string_view b_str, std::string_view c_str,
+                                 char* buf, std::size_t size) noexcept;
 
 /**
  * @brief Calculate square roots and extremum (if so)
  * and returns string with an answer.
  *
- * Calculate square roots from 3 strings.
+ * Calculate square roots from 3 strings. Strings are only viewed,
+ * so they can point right into the input buffer.
  * Equation looks like:
  *  a*x^2 + b*x + c = 0
  *
@@ -29,5 +219,4 @@
  *
  * @return string with result or an error description
  */
-std::string calculate_square_roots(std::string a_str, std::string b_str, std::string c_str);
-
+std::string calculate_square_roots(std::string_view a_str, std::string_view b_str, std::string_view c_str);
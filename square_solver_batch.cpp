@@ -0,0 +1,205 @@
+/**
+ * @file square_solver_batch.cpp
+ * @author Albert Kharisov <albkharisov@gmail.com>
+ * @version 1.0
+ *
+ * @brief Square equations solver for batches of equations.
+ *
+ * Expensive part (divisions and square root) is computed for all
+ * branches at once in vector registers, then every lane picks
+ * the branch `solve_square_equation()` would take. Operations are
+ * the same and in the same order, so the results are bit-identical.
+ * That's why this file has to be built without FP contraction.
+ */
+
+#include <cmath>
+#include "square_solver.hpp"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SQUARE_SOLVER_X86 1
+#include <immintrin.h>
+#endif
+
+
+namespace {
+
+/**
+ * Values of one equation needed by any branch of the solution.
+ */
+struct Lane {
+    /** Discriminant */
+    double d;
+    /** Root of the linear equation */
+    double linear;
+    /** First of two roots */
+    double x1;
+    /** Second of two roots */
+    double x2;
+    /** X of the extremum, also the root for zero discriminant */
+    double vertex;
+};
+
+/**
+ * Pick the branch `solve_square_equation()` takes.
+ * Has to be kept in sync with it.
+ */
+Roots pick(int a, int b, int c, const Lane& lane) {
+    const double epsilon = 1e-7;
+    Roots roots{};
+
+    if (a == 0) {
+        if (b == 0) {
+            roots.kind = RootsKind::any;
+        } else if (c == 0) {
+            roots.kind = RootsKind::one;
+            roots.x1 = 0;
+        } else {
+            roots.kind = RootsKind::one;
+            roots.x1 = lane.linear;
+        }
+        return roots;
+    }
+
+    if (lane.d < -epsilon) {
+        roots.kind = RootsKind::none;
+    } else if (std::abs(lane.d) < epsilon) {
+        roots.kind = RootsKind::one;
+        roots.x1 = lane.vertex;
+    } else {
+        roots.kind = RootsKind::two;
+        roots.x1 = lane.x1;
+        roots.x2 = lane.x2;
+    }
+
+    roots.has_extremum = true;
+    roots.minimum = a > 0;
+    roots.extremum = lane.vertex;
+    return roots;
+}
+
+/** One equation at a time */
+void solve_scalar(const int* a, const int* b, const int* c, std::size_t n, Roots* roots) {
+    for (std::size_t i = 0; i < n; ++i) {
+        roots[i] = solve_square_equation(a[i], b[i], c[i]);
+    }
+}
+
+#ifdef SQUARE_SOLVER_X86
+
+/** 4 equations at a time */
+__attribute__((target("avx2")))
+void solve_avx2(const int* a, const int* b, const int* c, std::size_t n, Roots* roots) {
+    constexpr std::size_t width = 4;
+    const auto zero = _mm256_setzero_pd();
+    const auto one = _mm256_set1_pd(1.);
+    const auto minus_one = _mm256_set1_pd(-1.);
+    const auto minus_half = _mm256_set1_pd(-0.5);
+    const auto two = _mm256_set1_pd(2.);
+    const auto four = _mm256_set1_pd(4.);
+
+    std::size_t i = 0;
+    for (; i + width <= n; i += width) {
+        const auto ai = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+        const auto bi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+        const auto ci = _mm_loadu_si128(reinterpret_cast<const __m128i*>(c + i));
+        const auto av = _mm256_cvtepi32_pd(ai);
+        const auto bv = _mm256_cvtepi32_pd(bi);
+        const auto cv = _mm256_cvtepi32_pd(ci);
+        // negate as int, see negate_coefficient()
+        const auto minus_bv = _mm256_cvtepi32_pd(_mm_sub_epi32(_mm_setzero_si128(), bi));
+
+        const auto d = _mm256_sub_pd(_mm256_mul_pd(bv, bv), _mm256_mul_pd(_mm256_mul_pd(four, av), cv));
+        const auto sign = _mm256_blendv_pd(one, minus_one, _mm256_cmp_pd(bv, zero, _CMP_LT_OQ));
+        const auto temp = _mm256_mul_pd(minus_half, _mm256_add_pd(bv, _mm256_mul_pd(sign, _mm256_sqrt_pd(d))));
+
+        alignas(32) double lanes[5][width];
+        _mm256_store_pd(lanes[0], d);
+        _mm256_store_pd(lanes[1], _mm256_div_pd(bv, cv));
+        _mm256_store_pd(lanes[2], _mm256_div_pd(cv, temp));
+        _mm256_store_pd(lanes[3], _mm256_div_pd(temp, av));
+        _mm256_store_pd(lanes[4], _mm256_div_pd(minus_bv, _mm256_mul_pd(two, av)));
+
+        for (std::size_t k = 0; k < width; ++k) {
+            const Lane lane{lanes[0][k], lanes[1][k], lanes[2][k], lanes[3][k], lanes[4][k]};
+            roots[i + k] = pick(a[i + k], b[i + k], c[i + k], lane);
+        }
+    }
+    solve_scalar(a + i, b + i, c + i, n - i, roots + i);
+}
+
+/** 8 equations at a time */
+__attribute__((target("avx512f")))
+void solve_avx512(const int* a, const int* b, const int* c, std::size_t n, Roots* roots) {
+    constexpr std::size_t width = 8;
+    const auto zero = _mm512_setzero_pd();
+    const auto one = _mm512_set1_pd(1.);
+    const auto minus_one = _mm512_set1_pd(-1.);
+    const auto minus_half = _mm512_set1_pd(-0.5);
+    const auto two = _mm512_set1_pd(2.);
+    const auto four = _mm512_set1_pd(4.);
+
+    std::size_t i = 0;
+    for (; i + width <= n; i += width) {
+        const auto ai = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+        const auto bi = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+        const auto ci = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(c + i));
+        const auto av = _mm512_cvtepi32_pd(ai);
+        const auto bv = _mm512_cvtepi32_pd(bi);
+        const auto cv = _mm512_cvtepi32_pd(ci);
+        // negate as int, see negate_coefficient()
+        const auto minus_bv = _mm512_cvtepi32_pd(_mm256_sub_epi32(_mm256_setzero_si256(), bi));
+
+        const auto d = _mm512_sub_pd(_mm512_mul_pd(bv, bv), _mm512_mul_pd(_mm512_mul_pd(four, av), cv));
+        const auto sign = _mm512_mask_blend_pd(_mm512_cmp_pd_mask(bv, zero, _CMP_LT_OQ), one, minus_one);
+        const auto temp = _mm512_mul_pd(minus_half, _mm512_add_pd(bv, _mm512_mul_pd(sign, _mm512_sqrt_pd(d))));
+
+        alignas(64) double lanes[5][width];
+        _mm512_store_pd(lanes[0], d);
+        _mm512_store_pd(lanes[1], _mm512_div_pd(bv, cv));
+        _mm512_store_pd(lanes[2], _mm512_div_pd(cv, temp));
+        _mm512_store_pd(lanes[3], _mm512_div_pd(temp, av));
+        _mm512_store_pd(lanes[4], _mm512_div_pd(minus_bv, _mm512_mul_pd(two, av)));
+
+        for (std::size_t k = 0; k < width; ++k) {
+            const Lane lane{lanes[0][k], lanes[1][k], lanes[2][k], lanes[3][k], lanes[4][k]};
+            roots[i + k] = pick(a[i + k], b[i + k], c[i + k], lane);
+        }
+    }
+    solve_avx2(a + i, b + i, c + i, n - i, roots + i);
+}
+
+#endif // SQUARE_SOLVER_X86
+
+} // namespace
+
+
+SimdLevel simd_level() noexcept {
+#ifdef SQUARE_SOLVER_X86
+    static const SimdLevel level = [] {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f")) { return SimdLevel::avx512; }
+        if (__builtin_cpu_supports("avx2")) { return SimdLevel::avx2; }
+        return SimdLevel::scalar;
+    }();
+    return level;
+#else
+    return SimdLevel::scalar;
+#endif
+}
+
+void solve_square_equations(const int* a, const int* b, const int* c, std::size_t n,
+                            Roots* roots, SimdLevel level) noexcept {
+    switch (level) {
+#ifdef SQUARE_SOLVER_X86
+    case SimdLevel::avx512:
+        solve_avx512(a, b, c, n, roots);
+        return;
+    case SimdLevel::avx2:
+        solve_avx2(a, b, c, n, roots);
+        return;
+#endif
+    default:
+        solve_scalar(a, b, c, n, roots);
+        return;
+    }
+}
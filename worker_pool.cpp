@@ -4,11 +4,12 @@
  * @version 1.0
  *
  * @brief Worker pool for parallel tasks processing.
- * TODO: refactor with templates for more versatility.
  */
 
+#include <algorithm>
 #include <condition_variable>
 #include <mutex>
+#include <stdexcept>
 #include <thread>
 #include <tuple>
 
@@ -16,62 +17,788 @@
 
 
 const unsigned int WorkerPool::nthreads = std::thread::hardware_concurrency();
+thread_local Worker* Worker::current = nullptr;
 
 
-void WorkerPool::set_job(Job::JobFunc job, Job::JobArgs args) {
-    auto promise = std::promise<Job::JobResult>();
-    auto future = promise.get_future();
+namespace {
 
-    {
-        std::lock_guard<std::mutex> l(m_results);
-        results.push(std::move(future));
+/** Hint the CPU that this is a spin-wait loop */
+inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+} // namespace
+
+
+void WorkerPool::wait_for_space() {
+    if (!full() || (Worker::current && &Worker::current->owner == this)) {
+        return;
+    }
+
+    // Resume at the half, so producers don't wake up on every taken job.
+    // Pairs with `taken()`: either it sees the waiter or we see the drained queue.
+    std::unique_lock<std::mutex> l(m_space);
+    space_waiters.fetch_add(1);
+    cv_space.wait(l, [this] { return pending.load() <= capacity / 2; });
+    space_waiters.fetch_sub(1);
+}
+
+void WorkerPool::taken(std::size_t n) {
+    const auto left = pending.fetch_sub(n) - n;
+    if (left <= capacity / 2 && space_waiters.load() > 0) {
+        { std::lock_guard<std::mutex> l(m_space); }
+        cv_space.notify_all();
+    }
+}
+
+void WorkerPool::finished(std::size_t n) {
+    // pairs with `wait_idle()` same way as `taken()` with `wait_for_space()`
+    if (unfinished.fetch_sub(n) == n && idle_waiters.load() > 0) {
+        { std::lock_guard<std::mutex> l(m_idle); }
+        cv_idle.notify_all();
     }
-    cv_results.notify_one();
+}
+
+void WorkerPool::wait_idle() {
+    if (Worker::current && &Worker::current->owner == this) {
+        throw std::logic_error("WorkerPool::wait_idle() called from a job");
+    }
+    std::unique_lock<std::mutex> l(m_idle);
+    idle_waiters.fetch_add(1);
+    cv_idle.wait(l, [this] { return unfinished.load() == 0; });
+    idle_waiters.fetch_sub(1);
+}
+
+bool WorkerPool::wait_idle(std::chrono::milliseconds timeout) {
+    if (Worker::current && &Worker::current->owner == this) {
+        throw std::logic_error("WorkerPool::wait_idle() called from a job");
+    }
+    std::unique_lock<std::mutex> l(m_idle);
+    idle_waiters.fetch_add(1);
+    const bool idle = cv_idle.wait_for(l, timeout, [this] { return unfinished.load() == 0; });
+    idle_waiters.fetch_sub(1);
+    return idle;
+}
+
+std::size_t WorkerPool::cancel() {
+    std::vector<Task> dropped;
+    auto take_all = [&dropped](auto& queue) {
+        for (; !queue.empty(); queue.pop_front()) { dropped.push_back(std::move(queue.front())); }
+    };
 
     {
         std::lock_guard<std::mutex> l(m_jobs);
-        jobs.push({std::move(job), std::move(args), std::move(promise)});
+        for (std::size_t c = 0; c < priority_classes; ++c) {
+            auto& queue = jobs.queues[c];
+            // jobs overflowed from the rings are counted under the lock
+            if (scheduling == Scheduling::lock_free) { overflowed[c].fetch_sub(queue.size()); }
+            take_all(queue);
+        }
+    }
+    for (auto& local : local_jobs) {
+        std::lock_guard<std::mutex> l(local->m);
+        for (auto& queue : local->jobs.queues) { take_all(queue); }
+    }
+    for (auto& ring : lock_free_jobs) {
+        if (!ring) { continue; }
+        for (Task task; ring->try_pop(task);) { dropped.push_back(std::move(task)); }
+    }
+
+    const auto n = dropped.size();
+    if (n == 0) { return 0; }
+    taken(n);
+    counters.cancelled.fetch_add(n, std::memory_order_relaxed);
+    // out of the locks, the hooks deliver answers and may resume coroutines
+    for (auto& task : dropped) {
+        const auto outer = Tracer::run_job(task.trace_id);
+        task.cancel();
+        Tracer::run_job(outer);
+    }
+    finished(n);
+    return n;
+}
+
+void WorkerPool::queued(Task& task, std::size_t depth) {
+    if (Tracer::enabled()) {
+        // jobs numbered before, see `set_job()`, keep their ids
+        if (!task.trace_id) { task.trace_id = Tracer::take_ids(1); }
+        Tracer::record(TraceEvent::enqueued, task.trace_id);
+    }
+    if (!stats_enabled()) { return; }
+    task.queued = std::chrono::steady_clock::now();
+    counters.update_max_pending(depth);
+}
+
+void WorkerPool::queued(std::vector<Task>& tasks, std::size_t depth) {
+    if (Tracer::enabled()) {
+        auto id = Tracer::take_ids(tasks.size());
+        for (auto& t : tasks) {
+            if (!t.trace_id) { t.trace_id = id++; }
+            Tracer::record(TraceEvent::enqueued, t.trace_id);
+        }
+    }
+    if (!stats_enabled()) { return; }
+    const auto now = std::chrono::steady_clock::now();
+    for (auto& t : tasks) { t.queued = now; }
+    counters.update_max_pending(depth);
+}
+
+void WorkerPool::push(Task&& task, Priority prio, bool counted) {
+    unfinished.fetch_add(1);
+    if (scheduling == Scheduling::work_stealing) {
+        push_local(std::move(task), prio, counted);
+        return;
+    }
+    const auto depth = counted ? pending.load() : pending.fetch_add(1) + 1;
+    if (scheduling == Scheduling::lock_free) {
+        queued(task, depth);
+        push_lock_free(std::move(task), prio);
+        wake(1);
+        return;
     }
-    cv_jobs.notify_one();
+
+    queued(task, depth);
+    {
+        std::unique_lock<std::mutex> l(m_jobs, std::defer_lock);
+        lock_counted(l, jobs_lock_wait());
+        jobs[prio].push_back(std::move(task));
+    }
+    notify(1, sleepers.load());
 }
 
-std::optional<Job::JobResult> WorkerPool::get_answer() {
-    std::future<Job::JobResult> result;
+void WorkerPool::push(std::vector<Task>&& tasks, Priority prio) {
+    unfinished.fetch_add(tasks.size());
+    if (scheduling == Scheduling::work_stealing) {
+        push_local(std::move(tasks), prio);
+        return;
+    }
+    if (scheduling == Scheduling::lock_free) {
+        queued(tasks, pending.fetch_add(tasks.size()) + tasks.size());
+        for (auto& t : tasks) { push_lock_free(std::move(t), prio); }
+        wake(tasks.size());
+        return;
+    }
 
+    queued(tasks, pending.fetch_add(tasks.size()) + tasks.size());
     {
-        std::unique_lock l(m_results);
-        cv_results.wait(l, [this]{ return !results.empty() || stop_flag.load(); });
-        if (stop_flag.load() && results.empty()) { return {}; }
-        result = std::move(results.front());
-        results.pop();
+        std::unique_lock<std::mutex> l(m_jobs, std::defer_lock);
+        lock_counted(l, jobs_lock_wait());
+        auto& queue = jobs[prio];
+        for (auto& t : tasks) { queue.push_back(std::move(t)); }
+    }
+    notify(tasks.size(), sleepers.load());
+}
+
+unsigned WorkerPool::local_index() {
+    if (Worker::current && &Worker::current->owner == this) {
+        return Worker::current->index;
     }
-    return {result.get()};
+    return next_local.fetch_add(1, std::memory_order_relaxed) % active.load();
+}
+
+void WorkerPool::wake(std::size_t n) {
+    const auto parked = sleepers.load();
+    if (parked == 0) { return; }
+
+    // worker could be between checking `pending` and waiting
+    { std::lock_guard<std::mutex> l(m_jobs); }
+    notify(n, parked);
+}
+
+void WorkerPool::notify(std::size_t n, unsigned parked) {
+    // Sleepers are counted under `m_jobs` before waiting, and the jobs
+    // were pushed under it, so a worker missed here sees the jobs.
+    // Spinning workers take the jobs themselves.
+    if (parked == 0) { return; }
+    if (n >= parked) {
+        cv_jobs.notify_all();
+    } else {
+        for (std::size_t i = 0; i < n; ++i) { cv_jobs.notify_one(); }
+    }
+}
+
+void WorkerPool::push_local(Task&& task, Priority prio, bool counted) {
+    const unsigned index = local_index();
+
+    // Count the job before it becomes visible, so `pending` never underflows.
+    // Pairs with the parking in Worker::process_local_queues(): either we see
+    // the sleeper or the sleeper sees the job.
+    queued(task, counted ? pending.load() : pending.fetch_add(1) + 1);
+    {
+        auto& local = *local_jobs[index];
+        std::lock_guard<std::mutex> l(local.m);
+        local.jobs[prio].push_back(std::move(task));
+    }
+    wake(1);
+}
+
+void WorkerPool::push_local(std::vector<Task>&& tasks, Priority prio) {
+    const std::size_t n = active.load();
+    const bool from_worker = Worker::current && &Worker::current->owner == this;
+    const unsigned first = local_index();
+    // Own deque takes everything, thieves will take their share.
+    // External batch is cut into one slice per deque.
+    const auto slices = from_worker ? 1 : std::min(n, tasks.size());
+    const auto slice = (tasks.size() + slices - 1) / slices;
+
+    queued(tasks, pending.fetch_add(tasks.size()) + tasks.size());
+    auto it = tasks.begin();
+    for (std::size_t i = 0; it != tasks.end(); ++i) {
+        auto end = it + std::min<std::size_t>(slice, tasks.end() - it);
+        auto& local = *local_jobs[from_worker ? first : (first + i) % n];
+        std::lock_guard<std::mutex> l(local.m);
+        auto& queue = local.jobs[prio];
+        for (; it != end; ++it) { queue.push_back(std::move(*it)); }
+    }
+    wake(tasks.size());
+}
+
+bool WorkerPool::pop_local(unsigned index, Task& task, bool steal) {
+    // retired workers' deques may still get a job from a late producer
+    const auto n = used_deques.load();
+
+    {
+        auto& own = *local_jobs[index];
+        std::lock_guard<std::mutex> l(own.m);
+        if (!own.jobs.empty()) {
+            auto& queue = own.jobs.pick(starvation_limit);
+            task = std::move(queue.front());
+            queue.pop_front();
+            taken();
+            return true;
+        }
+    }
+
+    if (!steal) { return false; }
+
+    // the own node first, so jobs and their data stay node-local
+    const unsigned own_node = node(index);
+    for (bool same_node : {true, false}) {
+        for (std::size_t i = 1; i < n; ++i) {
+            const auto v = static_cast<unsigned>((index + i) % n);
+            if ((node(v) == own_node) != same_node) { continue; }
+            auto& victim = *local_jobs[v];
+            std::unique_lock<std::mutex> l(victim.m, std::try_to_lock);
+            // skip busy deques, come back for them on the next round
+            if (!l.owns_lock() || victim.jobs.empty()) { continue; }
+            auto& queue = victim.jobs.pick(starvation_limit);
+            task = std::move(queue.back());
+            queue.pop_back();
+            taken();
+            return true;
+        }
+    }
+    return false;
+}
+
+void WorkerPool::push_lock_free(Task&& task, Priority prio) {
+    // Counted in `pending` before, pairs with the parking same way as push_local().
+    const auto c = static_cast<std::size_t>(prio);
+    if (lock_free_jobs[c]->try_push(std::move(task))) { return; }
+
+    std::unique_lock<std::mutex> l(m_jobs, std::defer_lock);
+    lock_counted(l, jobs_lock_wait());
+    jobs[prio].push_back(std::move(task));
+    overflowed[c].fetch_add(1);
+}
+
+bool WorkerPool::pop_lock_free(std::size_t c, Task& task) {
+    if (lock_free_jobs[c]->try_pop(task)) { return true; }
+    if (overflowed[c].load() == 0) { return false; }
+
+    auto* wait_ns = stats_enabled() && Worker::current ? &Worker::current->stats.jobs_lock_wait.value : nullptr;
+    std::unique_lock<std::mutex> l(m_jobs, std::defer_lock);
+    lock_counted(l, wait_ns);
+    auto& queue = jobs.queues[c];
+    if (queue.empty()) { return false; }
+    task = std::move(queue.front());
+    queue.pop_front();
+    overflowed[c].fetch_sub(1);
+    return true;
+}
+
+bool WorkerPool::pop_lock_free(std::array<unsigned, priority_classes>& passed, Task& task) {
+    std::size_t chosen = priority_classes;
+    // the lowest starving class is the longest waiting one
+    for (std::size_t c = priority_classes - 1; starvation_limit && c > 0; --c) {
+        if (passed[c] >= starvation_limit && pop_lock_free(c, task)) {
+            chosen = c;
+            break;
+        }
+    }
+    for (std::size_t c = 0; chosen == priority_classes && c < priority_classes; ++c) {
+        if (pop_lock_free(c, task)) { chosen = c; }
+    }
+    if (chosen == priority_classes) { return false; }
+
+    for (std::size_t c = chosen + 1; c < priority_classes; ++c) {
+        if (has_lock_free_jobs(c)) { ++passed[c]; }
+    }
+    passed[chosen] = 0;
+    taken();
+    return true;
+}
+
+std::uint64_t WorkerPool::reserve_seq(Results& res, std::size_t n) {
+    std::unique_lock<std::mutex> l(m_results, std::defer_lock);
+    lock_counted(l, results_lock_wait());
+    res.in_flight += n;
+    const auto seq = res.next_seq;
+    res.next_seq += n;
+    return seq;
+}
+
+void WorkerPool::complete(Results& res, std::uint64_t seq, Answer&& answer, std::exception_ptr error) {
+    bool last;
+    {
+        std::unique_lock<std::mutex> l(m_results, std::defer_lock);
+        lock_counted(l, results_lock_wait());
+        res.done.push_back({seq, std::move(answer)});
+        res.errors.push_back(std::move(error));
+        res.done_jobs.push_back(Tracer::running_job());
+        last = --res.in_flight == 0;
+    }
+    // all consumers have to see the last answer after stop
+    if (last) {
+        res.cv.notify_all();
+    } else {
+        res.cv.notify_one();
+    }
+}
+
+WorkerPool::PendingAnswer WorkerPool::reserve_answer(Priority prio) {
+    auto& res = answers(prio);
+    PendingAnswer pending(*this, res);
+    if (res.ring) {
+        pending.seq = res.ring->reserve();
+        return pending;
+    }
+    if (res.groups) {
+        pending.group = new PendingGroup(*res.groups, 1);
+        return pending;
+    }
+    if (unordered) {
+        pending.seq = reserve_seq(res, 1);
+        return pending;
+    }
+
+    {
+        std::unique_lock<std::mutex> l(m_results, std::defer_lock);
+        lock_counted(l, results_lock_wait());
+        res.futures.push(pending.promise.get_future());
+        // the job delivering it is not known yet, so it's the one reserving
+        res.future_jobs.push(Tracer::running_job());
+    }
+    res.cv.notify_one();
+    return pending;
+}
+
+std::optional<WorkerPool::Answer> WorkerPool::get_answer(Priority prio) {
+    auto tagged = get_tagged_answer(prio);
+    if (!tagged) { return {}; }
+    return {std::move(tagged->answer)};
+}
+
+std::optional<TaggedAnswer<WorkerPool::Answer>> WorkerPool::get_tagged_answer(Priority prio) {
+    auto& res = answers(prio);
+    if (res.ring) {
+        // the only consumer of the class
+        std::optional<Answer> answer;
+        try {
+            answer = res.ring->consume();
+        } catch (...) {
+            // the exception takes the number of the answer
+            consumed(res, res.ring->tag());
+            throw;
+        }
+        if (!answer) { return {}; }
+        return {{consumed(res, res.ring->tag()), std::move(*answer)}};
+    }
+
+    if (res.groups) {
+        // the only consumer of the class
+        if (res.current_pos == res.current.answers.size()) {
+            auto group = res.groups->consume();
+            if (!group) { return {}; }
+            res.current = std::move(*group);
+            res.current_pos = 0;
+        }
+        const auto i = res.current_pos++;
+        const auto seq = consumed(res, res.current.job(i));
+        if (res.current.errors[i]) { std::rethrow_exception(res.current.errors[i]); }
+        return {{seq, std::move(res.current.answers[i])}};
+    }
+
+    if (unordered) {
+        std::unique_lock<std::mutex> l(m_results, std::defer_lock);
+        lock_counted(l, results_lock_wait());
+        res.cv.wait(l, [this, &res] { return !res.done.empty() || (stop_flag.load() && res.in_flight == 0); });
+        if (res.done.empty()) { return {}; }
+        auto answer = std::move(res.done.front());
+        auto error = std::move(res.errors.front());
+        Tracer::record(TraceEvent::consumed, res.done_jobs.front());
+        res.done.pop_front();
+        res.errors.pop_front();
+        res.done_jobs.pop_front();
+        if (error) { std::rethrow_exception(error); }
+        return {std::move(answer)};
+    }
+
+    std::future<Answer> result;
+    std::uint64_t seq;
+
+    {
+        std::unique_lock<std::mutex> l(m_results, std::defer_lock);
+        lock_counted(l, results_lock_wait());
+        res.cv.wait(l, [this, &res]{ return res.deferred || !res.futures.empty() || stop_flag.load(); });
+        if (res.deferred) { std::rethrow_exception(std::exchange(res.deferred, nullptr)); }
+        if (stop_flag.load() && res.futures.empty()) { return {}; }
+        result = std::move(res.futures.front());
+        res.futures.pop();
+        seq = consumed(res, res.future_jobs.front());
+        res.future_jobs.pop();
+    }
+    return {{seq, result.get()}};
+}
+
+std::size_t WorkerPool::get_answers(std::vector<Answer>& out, std::size_t max, Priority prio) {
+    auto& res = answers(prio);
+    const auto first = out.size();
+    auto taken = [&out, first] { return out.size() - first; };
+    if (max == 0) { return 0; }
+
+    if (res.groups) {
+        for (;;) {
+            for (; taken() < max && res.current_pos < res.current.answers.size(); ++res.current_pos) {
+                auto& error = res.current.errors[res.current_pos];
+                if (error) {
+                    if (taken()) { return taken(); }
+                    consumed(res, res.current.job(res.current_pos++));
+                    std::rethrow_exception(error);
+                }
+                out.push_back(std::move(res.current.answers[res.current_pos]));
+                consumed(res, res.current.job(res.current_pos));
+            }
+            // wait only for the first group
+            if (taken() == max || (taken() && !res.groups->next_ready())) { return taken(); }
+            auto group = res.groups->consume();
+            if (!group) { return taken(); }
+            res.current = std::move(*group);
+            res.current_pos = 0;
+        }
+    }
+
+    if (unordered) {
+        std::unique_lock<std::mutex> l(m_results, std::defer_lock);
+        lock_counted(l, results_lock_wait());
+        res.cv.wait(l, [this, &res] { return !res.done.empty() || (stop_flag.load() && res.in_flight == 0); });
+        while (!res.done.empty() && taken() < max) {
+            if (res.errors.front() && taken()) { break; }
+            Tracer::record(TraceEvent::consumed, res.done_jobs.front());
+            auto answer = std::move(res.done.front().answer);
+            auto error = std::move(res.errors.front());
+            res.done.pop_front();
+            res.errors.pop_front();
+            res.done_jobs.pop_front();
+            if (error) { std::rethrow_exception(error); }
+            out.push_back(std::move(answer));
+        }
+        return taken();
+    }
+
+    // the first one waits and rethrows as usual
+    auto answer = get_tagged_answer(prio);
+    if (!answer) { return 0; }
+    out.push_back(std::move(answer->answer));
+
+    if (res.ring) {
+        // the only consumer of the class
+        while (taken() < max && res.ring->next_ready() && !res.ring->next_failed()) {
+            out.push_back(std::move(*res.ring->consume()));
+            consumed(res, res.ring->tag());
+        }
+        return taken();
+    }
+
+    std::unique_lock<std::mutex> l(m_results, std::defer_lock);
+    lock_counted(l, results_lock_wait());
+    while (taken() < max && !res.deferred && !res.futures.empty() &&
+           res.futures.front().wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+        auto result = std::move(res.futures.front());
+        res.futures.pop();
+        consumed(res, res.future_jobs.front());
+        res.future_jobs.pop();
+        try {
+            out.push_back(result.get());
+        } catch (...) {
+            // there is no telling it's an exception before taking it, so it's the next one
+            res.deferred = std::current_exception();
+        }
+    }
+    return taken();
+}
+
+Worker::Worker(WorkerPool& pool, unsigned idx)
+        : owner(pool),
+          index(idx),
+          spins(pool.idle.spins),
+          thread(&Worker::operator(), this) {}
+
+bool Worker::idle() {
+    const IdlePolicy& policy = owner.idle;
+    auto ready = [this] { return leaving() ||
+                                 owner.pending.load(std::memory_order_relaxed) > 0; };
+
+    auto found = [this, &policy] {
+        if (policy.adaptive) { spins = std::min(std::max(spins * 2, 1u), policy.spins); }
+        return true;
+    };
+
+    for (unsigned i = 0; i < spins; ++i) {
+        if (ready()) { return found(); }
+        cpu_relax();
+    }
+    for (unsigned i = 0; i < policy.yields; ++i) {
+        if (ready()) { return found(); }
+        std::this_thread::yield();
+    }
+    if (ready()) { return found(); }
+    if (policy.adaptive) { spins /= 2; }
+    return false;
+}
+
+unsigned WorkerPool::resize(unsigned num_threads) {
+    if (Worker::current && &Worker::current->owner == this) {
+        throw std::logic_error("WorkerPool::resize() called from a job");
+    }
+    num_threads = std::clamp(num_threads, 1u, max_workers);
+
+    std::unique_lock<std::mutex> l(m_workers);
+    const auto n = static_cast<unsigned>(workers.size());
+    if (num_threads > n) {
+        for (unsigned i = n; i < num_threads; ++i) {
+            workers.emplace_back(std::make_unique<Worker>(*this, i));
+        }
+        if (used_deques.load() < num_threads) { used_deques.store(num_threads); }
+        active.store(num_threads);
+        return num_threads;
+    }
+    if (num_threads == n) { return n; }
+
+    // new jobs go to the deques of the workers staying
+    active.store(num_threads);
+    {
+        // under the lock, so no worker misses the wake up
+        std::lock_guard<std::mutex> lj(m_jobs);
+        for (unsigned i = num_threads; i < n; ++i) { workers[i]->retire(); }
+    }
+    cv_jobs.notify_all();
+
+    for (unsigned i = num_threads; i < n; ++i) {
+        auto& w = *workers[i];
+        w.thread.join();
+        const auto ws = w.stats.snapshot();
+        retired_stats.started += ws.started;
+        retired_stats.completed += ws.completed;
+        retired_stats.busy += ws.busy;
+        retired_stats.idle += ws.idle;
+        retired_stats.jobs_lock_wait += ws.jobs_lock_wait;
+        retired_stats.queue_latency += ws.queue_latency;
+        retired_stats.run_latency += ws.run_latency;
+    }
+    workers.resize(num_threads);
+    return num_threads;
+}
+
+void WorkerPool::autoscale_loop() {
+    std::unique_lock<std::mutex> l(m_scaler);
+    std::chrono::milliseconds parked{0};
+
+    while (!cv_scaler.wait_for(l, autoscale.interval, [this] { return scaler_stop; })) {
+        const auto n = active.load();
+        if (pending.load() > n * autoscale.grow_depth && n < max_workers) {
+            resize(n + 1);
+            parked = std::chrono::milliseconds(0);
+        } else if (sleepers.load() > 0) {
+            // somebody has nothing to do since the last check
+            parked += autoscale.interval;
+            if (parked >= autoscale.shrink_idle && n > autoscale.min_threads) {
+                resize(n - 1);
+                parked = std::chrono::milliseconds(0);
+            }
+        } else {
+            parked = std::chrono::milliseconds(0);
+        }
+    }
+}
+
+PoolStats WorkerPool::stats() const {
+    PoolStats s;
+    if (!stats_enabled()) { return s; }
+
+    std::lock_guard<std::mutex> l(m_workers);
+    s.enabled = true;
+    s.pending = pending.load();
+    s.max_pending = counters.max_pending.load();
+    s.jobs_lock_wait = std::chrono::nanoseconds(counters.jobs_lock_wait.load());
+    s.results_lock_wait = std::chrono::nanoseconds(counters.results_lock_wait.load());
+    for (const auto& w : workers) {
+        s.workers.push_back(w->stats.snapshot());
+        const auto& ws = s.workers.back();
+        s.submitted += ws.started;
+        s.completed += ws.completed;
+        s.jobs_lock_wait += ws.jobs_lock_wait;
+        s.queue_latency += ws.queue_latency;
+        s.run_latency += ws.run_latency;
+    }
+    s.submitted += retired_stats.started;
+    s.completed += retired_stats.completed;
+    s.jobs_lock_wait += retired_stats.jobs_lock_wait;
+    s.queue_latency += retired_stats.queue_latency;
+    s.run_latency += retired_stats.run_latency;
+    // taken jobs are started, the rest are pending
+    s.submitted += s.pending;
+    s.cancelled = counters.cancelled.load();
+    s.submitted += s.cancelled;
+    return s;
+}
+
+void Worker::run(Task& task) {
+    const auto job = task.trace_id;
+    Tracer::record(TraceEvent::dequeued, job);
+    // answers delivered by the job reach the consumer with its id
+    const auto outer = Tracer::run_job(job);
+    if (!owner.stats_enabled()) {
+        task();
+        Tracer::run_job(outer);
+        Tracer::record(TraceEvent::finished, job);
+        owner.finished();
+        return;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    stats.started.add(1);
+    stats.idle.add(std::chrono::duration_cast<std::chrono::nanoseconds>(start - idle_since).count());
+    StatsSlot::record(stats.queue_latency, start - task.queued);
+
+    task();
+    Tracer::run_job(outer);
+    Tracer::record(TraceEvent::finished, job);
+
+    const auto end = std::chrono::steady_clock::now();
+    stats.busy.add(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+    StatsSlot::record(stats.run_latency, end - start);
+    stats.completed.add(1);
+    idle_since = end;
+    owner.finished();
 }
 
 void Worker::operator() () {
+    current = this;
+    if (Tracer::enabled()) { Tracer::name_thread("worker " + std::to_string(index)); }
+    idle_since = std::chrono::steady_clock::now();
+    if (!owner.placement.empty()) { pin_current_thread(owner.placement[index]); }
+
+    if (owner.scheduling == Scheduling::work_stealing) {
+        process_local_queues();
+    } else if (owner.scheduling == Scheduling::lock_free) {
+        process_lock_free_queues();
+    } else {
+        process_shared_queue();
+    }
+
+    // the jobs left are for the others, some of them may be parked
+    if (retire_flag.load() && owner.pending.load() > 0) {
+        owner.wake(owner.pending.load());
+    }
+}
+
+void Worker::process_shared_queue() {
     std::mutex& m = owner.get_mutex();
     std::condition_variable& cv = owner.get_condvar();
     auto& jobs = owner.get_jobs();
 
     for (;;) {
-        std::unique_lock<std::mutex> l(m);
+        // a job on the way may be counted and not pushed yet, just get the lock then
+        if (owner.pending.load() == 0) { idle(); }
+
+        std::unique_lock<std::mutex> l(m, std::defer_lock);
+        lock_counted(l, owner.stats_enabled() ? &stats.jobs_lock_wait.value : nullptr);
 
-        cv.wait(l, [this, &jobs] { return stop_flag.load() || !jobs.empty(); });
+        if (!leaving() && jobs.empty()) {
+            owner.sleepers.fetch_add(1);
+            cv.wait(l, [this, &jobs] { return leaving() || !jobs.empty(); });
+            owner.sleepers.fetch_sub(1);
+        }
 
-        if (stop_flag.load() && jobs.empty()) {
+        if (retire_flag.load() || (stop_flag.load() && jobs.empty())) {
             break;
         }
 
-        auto& job = jobs.front();
-        // Move instead of refs because we have to destruct the tuple from queue.
+        // Move instead of refs because we have to destruct the task from queue.
         // If do so after processing the job - we would have to lock mutex again.
-        auto func = std::move(Job::func(job));
-        auto args = std::move(Job::args(job));
-        auto promise = std::move(Job::promise(job));
-        jobs.pop();
+        auto& queue = jobs.pick(owner.starvation_limit);
+        auto task = std::move(queue.front());
+        queue.pop_front();
         l.unlock();
+        owner.taken();
 
-        promise.set_value(std::apply(func, args));
+        run(task);
     }
 }
 
+
+void Worker::process_local_queues() {
+    for (;;) {
+        Task task;
+        // leaving worker only empties its own deque, stealing would never end
+        if (owner.pop_local(index, task, !retire_flag.load())) {
+            run(task);
+            continue;
+        }
+        if (retire_flag.load() || (stop_flag.load() && owner.pending.load() == 0)) {
+            break;
+        }
+        // pending jobs may be in a deque locked by someone, retry it first
+        if (owner.pending.load() > 0 || idle()) { continue; }
+
+        std::unique_lock<std::mutex> l(owner.get_mutex());
+        owner.sleepers.fetch_add(1);
+        owner.get_condvar().wait(l, [this] {
+            return leaving() || owner.pending.load() > 0;
+        });
+        owner.sleepers.fetch_sub(1);
+
+        if (stop_flag.load() && owner.pending.load() == 0) {
+            break;
+        }
+    }
+}
+
+void Worker::process_lock_free_queues() {
+    for (;;) {
+        // leaving worker leaves the rest of the jobs to the others
+        if (retire_flag.load() || (stop_flag.load() && owner.pending.load() == 0)) {
+            break;
+        }
+
+        Task task;
+        if (owner.pop_lock_free(passed, task)) {
+            run(task);
+            continue;
+        }
+        // a job may be counted and not pushed yet, retry it first
+        if (owner.pending.load() > 0 || idle()) { continue; }
+
+        std::unique_lock<std::mutex> l(owner.get_mutex());
+        owner.sleepers.fetch_add(1);
+        owner.get_condvar().wait(l, [this] {
+            return leaving() || owner.pending.load() > 0;
+        });
+        owner.sleepers.fetch_sub(1);
+    }
+}
@@ -4,62 +4,247 @@
  * @version 1.0
  *
  * @brief Worker pool for parallel tasks processing.
- * TODO: refactor with templates for more versatility.
  */
 
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <iterator>
+#include <functional>
 #include <future>
 #include <iostream>
+#include <limits>
 #include <memory>
 #include <mutex>
+#include <new>
 #include <queue>
+#include <stdexcept>
 #include <string>
 #include <thread>
+#include <tuple>
+#include <type_traits>
 #include <optional>
+#include <utility>
+#include <vector>
+#include "cpu_placement.hpp"
+#include "mpmc_queue.hpp"
+#include "pool_stats.hpp"
+#include "pool_trace.hpp"
+#include "result_ring.hpp"
+#include "slab_allocator.hpp"
+
+class WorkerPool;
+class Task;
 
 /**
- * @brief Debug class for thread-safe cout printing.
+ * @brief Jobs scheduling strategy of the worker pool.
  */
-class SafeCout {
-    /** mutex guard for cout */
-    static inline std::mutex m;
+enum class Scheduling {
+    /** All workers take jobs from one shared FIFO queue */
+    fifo,
+    /**
+     * Every worker owns a deque of jobs. Jobs submitted from a worker
+     * go to its own deque, external jobs are spread round-robin.
+     * Idle workers steal from the others.
+     */
+    work_stealing,
+    /**
+     * All workers take jobs from shared bounded lock-free rings, one per
+     * priority class. Jobs not fitting the ring go to the mutex queue.
+     * Mutex and condvar are only used for parking idle workers.
+     */
+    lock_free,
+};
 
-public:
-    /** A constructor. Using RAII for management. */
-    SafeCout()  { SafeCout::m.lock(); }
-    /** A destructor. Using RAII for management. */
-    ~SafeCout() { SafeCout::m.unlock(); }
-
-    /** An operator<<. Overloads common way of printing in C++. */
-    template <typename T>
-    SafeCout& operator<<(const T& t) {
-        std::cout << t;
-        return *this;
-    }
+/**
+ * @brief How answers of `set_job()` are delivered to `get_answer()`.
+ */
+enum class Completion {
+    /** Every job gets a promise, `get_answer()` waits for the futures in order */
+    futures,
+    /**
+     * Every job gets a sequence number and writes to a preallocated slot
+     * of a bounded ring, `get_answer()` takes the slots in order.
+     * Only one thread may call `get_answer()`.
+     * `set_job()` blocks while the ring is full.
+     */
+    ring,
+    /**
+     * Same as Completion::ring, but a ring slot holds the answers of the
+     * whole `set_jobs()` batch. They are published at once when the last
+     * job of the batch is done and taken at once by `get_answers()`,
+     * so the consumer wakes up once per batch. Only one thread may
+     * call `get_answer()`. `set_jobs()` blocks while the ring is full.
+     */
+    batched,
+    /**
+     * Answers are delivered as soon as the jobs are done, so a slow job
+     * doesn't hold back the others. `get_tagged_answer()` tells
+     * the sequence number of the job the answer is for.
+     */
+    unordered,
+};
 
-    /** An operator<<(for manip). An overloading for std::endl and others. */
-    SafeCout& operator<<(std::ostream& (*manip)(std::ostream&)) {
-        std::cout << manip;
-        return *this;
-    }
+/**
+ * @brief Priority class of the jobs.
+ *
+ * Every class has its own queues and its own ordered answers,
+ * see `WorkerPool::get_answer(Priority)`.
+ */
+enum class Priority {
+    /** Latency sensitive jobs, taken first */
+    high,
+    /** Jobs set without a priority */
+    normal,
+    /** Bulk jobs, taken when there is nothing more urgent */
+    background,
 };
 
-class WorkerPool;
+/** Number of priority classes */
+inline constexpr std::size_t priority_classes = 3;
+
+/**
+ * @brief What an idle worker does before parking on the condvar.
+ *
+ * Spinning keeps the worker on the CPU, so a job arriving soon after
+ * is taken without a futex wake up and submitting doesn't notify at all.
+ * Costs CPU time while the pool is idle.
+ */
+struct IdlePolicy {
+    /** Checks for a job separated by the pause instruction, 0 to skip spinning */
+    unsigned spins = 2048;
+    /** Checks for a job separated by `std::this_thread::yield()` after spinning */
+    unsigned yields = 16;
+    /**
+     * Halve spins of a worker every time it parks anyway,
+     * double them back every time a job is found while spinning.
+     */
+    bool adaptive = true;
+};
+
+/**
+ * @brief Policy of growing and shrinking the pool by itself.
+ *
+ * The load is checked every `interval`: the pool grows by a worker
+ * when the queues are deep and shrinks by a worker when some worker
+ * has been parked all along for `shrink_idle`.
+ */
+struct AutoScale {
+    /** Let the pool resize itself */
+    bool enabled = false;
+    /** Fewest workers to shrink to */
+    unsigned min_threads = 1;
+    /** Period of checking the load */
+    std::chrono::milliseconds interval{20};
+    /** Grow when more jobs than this per worker are waiting */
+    std::size_t grow_depth = 4;
+    /** Shrink when some worker has been parked for this long */
+    std::chrono::milliseconds shrink_idle{500};
+};
+
+/**
+ * @brief Tunables of the worker pool.
+ */
+struct WorkerPoolOptions {
+    /** Jobs scheduling strategy */
+    Scheduling scheduling = Scheduling::fifo;
+    /** Answers delivery */
+    Completion completion = Completion::futures;
+    /** Maximum number of answers (batches in Completion::batched mode) in flight */
+    std::size_t ring_size = 4096;
+    /** Slots of every jobs ring in Scheduling::lock_free mode, rounded up to power of 2, at least 2 */
+    std::size_t lock_free_size = 4096;
+    /**
+     * High-water mark of jobs waiting in the queues, 0 for unbounded.
+     * When reached, submitting blocks until the queues drain to a half.
+     * A batch is admitted as a whole, so it may overshoot the mark.
+     */
+    std::size_t queue_capacity = 0;
+    /** Idling of the workers before parking */
+    IdlePolicy idle;
+    /**
+     * Jobs of higher classes taken while a lower class waits,
+     * then one job of the lower class is taken. 0 for strict priorities.
+     */
+    unsigned starvation_limit = 16;
+    /**
+     * Pinning of the workers to CPUs. With Placement::numa and
+     * Scheduling::work_stealing idle workers steal from the workers
+     * of their own node first.
+     */
+    Placement placement = Placement::none;
+    /** Number of placement slots taken by other threads of the program, see `placement_slots()` */
+    unsigned placement_offset = 0;
+    /** Collect counters for `WorkerPool::stats()`, see WORKER_POOL_STATS */
+    bool stats = false;
+    /** Most workers `WorkerPool::resize()` may start, 0 for the hardware concurrency */
+    unsigned max_threads = 0;
+    /** Resizing of the pool by itself */
+    AutoScale autoscale;
+    /** Print the start up line */
+    bool verbose = true;
+};
+
+/**
+ * @brief Exception delivered in place of the answers of the jobs
+ * discarded by `WorkerPool::cancel()`.
+ */
+class JobCancelled : public std::runtime_error {
+public:
+    /** A constructor */
+    JobCancelled() : std::runtime_error("job cancelled") {}
+};
+
+/**
+ * @brief Answer with the sequence number of its job.
+ *
+ * Jobs are numbered from 0 in the order they are set.
+ */
+template <typename T>
+struct TaggedAnswer {
+    /** Sequence number of the job */
+    std::uint64_t seq;
+    /** Answer of the job */
+    T answer;
+};
 
 /**
  * Class for processing jobs.
  * This class manages internal thread's lifetime.
  * It only should be manages from WorkerPool class.
  */
-class Worker {
+class alignas(cache_line_size) Worker {
     friend WorkerPool;
     /** Link to the owner of worker */
     WorkerPool& owner;
+    /** Index of the worker in the pool (and of its local jobs deque) */
+    const unsigned index;
+
+    // Written by the pool once, polled by the worker between jobs
+
     /** Flag to terminate the worker */
-    std::atomic<bool> stop_flag{false};
-    /** Thread in which worker processes jobs */
+    alignas(cache_line_size) std::atomic<bool> stop_flag{false};
+    /** Flag to leave the pool, the jobs left are done by other workers */
+    std::atomic<bool> retire_flag{false};
+
+    // Written by the worker only
+
+    /** Current number of spins before yielding, see IdlePolicy::adaptive */
+    alignas(cache_line_size) unsigned spins;
+    /** Jobs of higher classes taken in front of each class in Scheduling::lock_free mode */
+    std::array<unsigned, priority_classes> passed{};
+    /** End of the last job, for the idle time */
+    std::chrono::steady_clock::time_point idle_since;
+    /** Counters of the worker, updated only if the pool collects stats, read by `stats()` */
+    StatsSlot stats;
+    /** Thread in which worker processes jobs, started after the rest is set up */
     std::thread thread;
 
     /**
@@ -71,6 +256,26 @@ class Worker {
      */
     void operator()();
 
+    /** Run the task, accounting it in the stats */
+    void run(Task& task);
+    /** Processing loop for the Scheduling::fifo mode */
+    void process_shared_queue();
+    /** Processing loop for the Scheduling::work_stealing mode */
+    void process_local_queues();
+    /** Processing loop for the Scheduling::lock_free mode */
+    void process_lock_free_queues();
+    /** Check if the worker is asked to stop or to retire */
+    bool leaving() const { return stop_flag.load() || retire_flag.load(); }
+    /**
+     * Spin, then yield until there is a job or stop is requested.
+     *
+     * @return false if the worker has to park
+     */
+    bool idle();
+
+    /** Worker running in the current thread (nullptr if none) */
+    static thread_local Worker* current;
+
     /** Forbid this. Can't create Worker outside the pool */
     Worker(const Worker&) = delete;
     /** Forbid this. Can't create Worker outside the pool */
@@ -82,14 +287,14 @@ class Worker {
 public:
     /** Signal to terminate the worker */
     void stop(void) { stop_flag.store(true); }
+    /** Signal to leave the pool right after the current job */
+    void retire(void) { retire_flag.store(true); }
 
     /**
      * A constructor.
      * Immediately starts jobs processing.
      */
-    Worker (WorkerPool& pool)
-            : owner(pool),
-              thread(&Worker::operator(), this) {}
+    Worker (WorkerPool& pool, unsigned idx);
 
     /**
      * A destructor.
@@ -104,16 +309,29 @@ public:
 
 /**
  * Handy class for retreiving job func/arg/promise from tuple.
+ *
+ * Callable and arguments are stored by their own types, so
+ * there is no type erasure between the job and its call.
+ *
+ * An exception thrown by the job is delivered in place of its result.
+ * Calls which can't throw are made without catching anything.
+ *
+ * @tparam Func callable type
+ * @tparam Args types of arguments stored for the call
  */
+template <typename Func, typename... Args>
 struct Job {
-    /** Job result type */
-    using JobResult = std::string;
-    /** Job arguments tuple type */
-    using JobArgs = std::tuple<std::string, std::string, std::string>;
     /** Job function type */
-    using JobFunc = std::function<JobResult(std::string, std::string, std::string)>;
+    using JobFunc = Func;
+    /** Job arguments tuple type */
+    using JobArgs = std::tuple<Args...>;
+    /** Job result type */
+    using JobResult = std::invoke_result_t<Func&, Args...>;
     /** Unit of storage all necessery parameters to process job */
     using JobRequest = std::tuple<JobFunc, JobArgs, std::promise<JobResult>>;
+    /** The call and passing its result on are noexcept, no exception has to be caught */
+    static constexpr bool nothrow = std::is_nothrow_invocable_v<Func&, Args...> &&
+            (std::is_void_v<JobResult> || std::is_nothrow_move_constructible_v<JobResult>);
 
     /** Get a job function from tuple */
     static auto& func(JobRequest& request) { return std::get<0>(request); }
@@ -121,6 +339,412 @@ struct Job {
     static auto& args(JobRequest& request) { return std::get<1>(request); }
     /** Get a promise from tuple */
     static auto& promise(JobRequest& request) { return std::get<2>(request); }
+
+    /** Pack a job function and its arguments into a request */
+    template <typename F, typename... A>
+    static JobRequest make(F&& f, A&&... args) {
+        return JobRequest(std::forward<F>(f), JobArgs(std::forward<A>(args)...),
+                          std::promise<JobResult>());
+    }
+
+    /** Pack a tuple-like arguments into JobArgs */
+    template <typename Tuple>
+    static JobArgs pack(Tuple&& t) {
+        return std::apply([](auto&&... a) { return JobArgs(std::forward<decltype(a)>(a)...); },
+                          std::forward<Tuple>(t));
+    }
+
+    /** Run the job function. Arguments are moved into the call. */
+    static JobResult call(JobFunc& f, JobArgs& args) noexcept(nothrow) { return std::apply(f, std::move(args)); }
+
+    /**
+     * Run the job function and pass on what it ends with.
+     *
+     * @param done called with the result
+     * @param fail called with the exception thrown by the job
+     */
+    template <typename Done, typename Fail>
+    static void call(JobFunc& f, JobArgs& args, Done&& done, Fail&& fail) {
+        if constexpr (nothrow) {
+            done(call(f, args));
+        } else {
+            std::optional<JobResult> result;
+            try {
+                result.emplace(call(f, args));
+            } catch (...) {
+                fail(std::current_exception());
+                return;
+            }
+            done(std::move(*result));
+        }
+    }
+
+    /** Run the job and fulfill its promise. Arguments are moved into the call. */
+    static void process(JobRequest& request) {
+        if constexpr (nothrow) {
+            fulfill(request);
+        } else {
+            try {
+                fulfill(request);
+            } catch (...) {
+                promise(request).set_exception(std::current_exception());
+            }
+        }
+    }
+
+private:
+    /** Run the job and set the value of its promise */
+    static void fulfill(JobRequest& request) {
+        if constexpr (std::is_void_v<JobResult>) {
+            call(func(request), args(request));
+            promise(request).set_value();
+        } else {
+            promise(request).set_value(call(func(request), args(request)));
+        }
+    }
+};
+
+/**
+ * Job type for a callable and a tuple-like pack of its arguments
+ * (std::tuple, std::pair, std::array).
+ */
+template <typename Func, typename Tuple,
+          typename = std::make_index_sequence<std::tuple_size_v<Tuple>>>
+struct JobFor;
+
+/** Specialization unpacking tuple elements into Job arguments */
+template <typename Func, typename Tuple, std::size_t... I>
+struct JobFor<Func, Tuple, std::index_sequence<I...>> {
+    /** Job type */
+    using type = Job<Func, std::tuple_element_t<I, Tuple>...>;
+};
+
+/**
+ * Callable running the job and fulfilling its promise.
+ * Cancelling it delivers JobCancelled to the future.
+ */
+template <typename J>
+struct PromiseTask {
+    /** The job and its promise */
+    typename J::JobRequest request;
+
+    /** Run the job */
+    void operator()() { J::process(request); }
+    /** Cancel hook, see Task */
+    void cancel() { J::promise(request).set_exception(std::make_exception_ptr(JobCancelled())); }
+};
+
+/** Job with the original fixed signature of three strings */
+using StringJob = Job<std::function<std::string(std::string, std::string, std::string)>,
+                      std::string, std::string, std::string>;
+
+/**
+ * Size of the task record in bytes, a multiple of the cache line. Jobs
+ * fitting in what is left after its 24 bytes header are stored inline,
+ * bigger ones are allocated from the slabs. Larger records keep bigger
+ * jobs inline, but a long queue of them takes more memory traffic.
+ */
+#ifndef WORKER_POOL_TASK_SIZE
+#define WORKER_POOL_TASK_SIZE 64
+#endif
+
+/**
+ * Type-erased unit of work stored in the jobs queues.
+ * Move-only, owns the job. Jobs are stored inline in the cache line
+ * aligned record (see WORKER_POOL_TASK_SIZE), so queueing one costs no
+ * allocation and running it one indirect call. Jobs too big for it,
+ * aligned to more than a pointer or throwing on move are allocated from slabs,
+ * so workers freeing them don't contend with producers in malloc.
+ *
+ * A callable with a `cancel()` member has it called instead of itself
+ * when the task is discarded, so whoever waits for it is released.
+ */
+class alignas(cache_line_size) Task {
+    /** Operations on the stored job, one static table per type */
+    struct Ops {
+        /** Run the job */
+        void (*run)(void* storage);
+        /** Call the cancel hook of the job */
+        void (*cancel)(void* storage);
+        /** Move the job to the empty storage and destroy the source, null to copy the bytes */
+        void (*relocate)(void* from, void* to) noexcept;
+        /** Destroy the job, null if there is nothing to do */
+        void (*destroy)(void* storage) noexcept;
+    };
+
+    /** Check if the callable has a cancel hook */
+    template <typename F, typename = void>
+    struct HasCancel : std::false_type {};
+    /** Specialization for the callables with `cancel()` */
+    template <typename F>
+    struct HasCancel<F, std::void_t<decltype(std::declval<F&>().cancel())>> : std::true_type {};
+
+    /** Job allocated out of the record */
+    template <typename F>
+    struct Boxed {
+        F f;
+
+        static void* operator new(std::size_t size) { return slab_allocate(size); }
+        static void operator delete(void* ptr, std::size_t size) noexcept { slab_deallocate(ptr, size); }
+        // over-aligned jobs don't fit the slabs
+        static void* operator new(std::size_t size, std::align_val_t al) { return ::operator new(size, al); }
+        static void operator delete(void* ptr, std::size_t size, std::align_val_t al) noexcept {
+            ::operator delete(ptr, size, al);
+        }
+    };
+
+    /** Storage of the job, what is left of the record */
+    static constexpr std::size_t inline_size = WORKER_POOL_TASK_SIZE - sizeof(const Ops*)
+                                               - sizeof(std::chrono::steady_clock::time_point)
+                                               - sizeof(std::uint64_t);
+    /** Alignment of the storage, it follows the 8 byte fields of the header */
+    static constexpr std::size_t inline_align = alignof(std::uint64_t);
+
+    /** Check if the job is stored inline */
+    template <typename F>
+    static constexpr bool fits_inline = sizeof(F) <= inline_size && alignof(F) <= inline_align
+                                        && std::is_nothrow_move_constructible_v<F>;
+
+    /** Check if the bytes of the job may be copied instead of moving it */
+    template <typename F>
+    static constexpr bool trivially_relocatable = std::is_trivially_move_constructible_v<F>
+                                                  && std::is_trivially_destructible_v<F>;
+
+    /** Get the job stored inline */
+    template <typename F>
+    static F& inline_job(void* storage) { return *std::launder(static_cast<F*>(storage)); }
+    /** Get the job allocated out of the record */
+    template <typename F>
+    static F& boxed_job(void* storage) { return (*static_cast<Boxed<F>**>(storage))->f; }
+
+    /** Operations on the job stored inline */
+    template <typename F>
+    static constexpr Ops inline_ops{
+        [](void* storage) { inline_job<F>(storage)(); },
+        [](void* storage) {
+            if constexpr (HasCancel<F>::value) { inline_job<F>(storage).cancel(); }
+        },
+        trivially_relocatable<F> ? nullptr : +[](void* from, void* to) noexcept {
+            new (to) F(std::move(inline_job<F>(from)));
+            inline_job<F>(from).~F();
+        },
+        std::is_trivially_destructible_v<F> ? nullptr
+                                            : +[](void* storage) noexcept { inline_job<F>(storage).~F(); },
+    };
+
+    /** Operations on the job allocated out of the record */
+    template <typename F>
+    static constexpr Ops boxed_ops{
+        [](void* storage) { boxed_job<F>(storage)(); },
+        [](void* storage) {
+            if constexpr (HasCancel<F>::value) { boxed_job<F>(storage).cancel(); }
+        },
+        nullptr,
+        [](void* storage) noexcept { delete *static_cast<Boxed<F>**>(storage); },
+    };
+
+    /** Operations on the stored job, null if there is none */
+    const Ops* ops = nullptr;
+
+public:
+    /** Time the task was queued, set only if the pool collects stats */
+    std::chrono::steady_clock::time_point queued;
+    /** Id of the job in the trace, see `Tracer::take_ids()`. Set only if tracing is on */
+    std::uint64_t trace_id = 0;
+
+private:
+    /** The job or the pointer to it */
+    alignas(inline_align) unsigned char storage[inline_size];
+
+    /** Destroy the job, if any */
+    void reset() noexcept {
+        if (ops && ops->destroy) { ops->destroy(storage); }
+        ops = nullptr;
+    }
+
+    /** Take the job of the other task, this one has to be empty */
+    void take(Task& other) noexcept {
+        ops = other.ops;
+        queued = other.queued;
+        trace_id = other.trace_id;
+        if (!ops) { return; }
+        if (ops->relocate) {
+            ops->relocate(other.storage, storage);
+        } else {
+            std::memcpy(storage, other.storage, inline_size);
+        }
+        other.ops = nullptr;
+    }
+
+public:
+    /** An empty task */
+    Task() = default;
+
+    /**
+     * A constructor.
+     *
+     * @param f callable without arguments to be run by a worker
+     */
+    template <typename F, typename = std::enable_if_t<!std::is_same_v<std::decay_t<F>, Task>>>
+    explicit Task(F&& f) {
+        using Job = std::decay_t<F>;
+        if constexpr (fits_inline<Job>) {
+            new (storage) Job(std::forward<F>(f));
+            ops = &inline_ops<Job>;
+        } else {
+            auto* boxed = new Boxed<Job>{Job(std::forward<F>(f))};
+            std::memcpy(storage, &boxed, sizeof(boxed));
+            ops = &boxed_ops<Job>;
+        }
+    }
+
+    /** Move constructor, the source is left empty */
+    Task(Task&& other) noexcept { take(other); }
+
+    /** Move assignment, the source is left empty */
+    Task& operator=(Task&& other) noexcept {
+        if (this != &other) {
+            reset();
+            take(other);
+        }
+        return *this;
+    }
+
+    /** A destructor. Destroys the job */
+    ~Task() { reset(); }
+
+    /** Run the job */
+    void operator()() { ops->run(storage); }
+
+    /** Discard the job without running it, calls its cancel hook */
+    void cancel() {
+        ops->cancel(storage);
+        reset();
+    }
+
+    /** Check if task holds a job */
+    explicit operator bool() const { return ops != nullptr; }
+};
+
+static_assert(sizeof(Task) == WORKER_POOL_TASK_SIZE, "WORKER_POOL_TASK_SIZE has to be a multiple of cache lines");
+
+/**
+ * Growable ring of tasks, a deque without the node allocations.
+ * Storage is kept when the queue empties, so in the steady state
+ * queueing a task only moves it. Not synchronized.
+ */
+class TaskQueue {
+    /** Storage, `capacity` tasks */
+    std::unique_ptr<Task[]> tasks;
+    /** Size of the storage, power of 2 or 0 */
+    std::size_t capacity = 0;
+    /** Position of the front task */
+    std::size_t head = 0;
+    /** Number of tasks */
+    std::size_t count = 0;
+
+    /** Task `i` from the front */
+    Task& at(std::size_t i) { return tasks[(head + i) & (capacity - 1)]; }
+
+    /** Double the storage */
+    void grow() {
+        const auto bigger = capacity ? capacity * 2 : 16;
+        auto fresh = std::make_unique<Task[]>(bigger);
+        for (std::size_t i = 0; i < count; ++i) { fresh[i] = std::move(at(i)); }
+        tasks = std::move(fresh);
+        capacity = bigger;
+        head = 0;
+    }
+
+public:
+    /** Check if there are no tasks */
+    bool empty() const { return count == 0; }
+    /** Number of tasks */
+    std::size_t size() const { return count; }
+
+    /** The oldest task */
+    Task& front() { return at(0); }
+    /** The newest task */
+    Task& back() { return at(count - 1); }
+
+    /** Add the task after the others */
+    void push_back(Task&& task) {
+        if (count == capacity) { grow(); }
+        at(count++) = std::move(task);
+    }
+
+    /** Drop the oldest task */
+    void pop_front() {
+        front() = Task();
+        head = (head + 1) & (capacity - 1);
+        --count;
+    }
+
+    /** Drop the newest task */
+    void pop_back() {
+        back() = Task();
+        --count;
+    }
+};
+
+/**
+ * Queues of tasks for every priority class and the choice between them.
+ * Not synchronized, guarded by the mutex of the owner.
+ *
+ * @tparam Queue container of tasks of one class
+ */
+template <typename Queue>
+struct PriorityQueues {
+    /** Tasks of every class, indexed by Priority */
+    std::array<Queue, priority_classes> queues;
+    /** Jobs of higher classes taken in front of each class while it has jobs */
+    std::array<unsigned, priority_classes> passed{};
+
+    /** Check if there are no tasks */
+    bool empty() const {
+        return std::all_of(queues.begin(), queues.end(), [](const Queue& q) { return q.empty(); });
+    }
+
+    /** Tasks of the class */
+    Queue& operator[](Priority p) { return queues[static_cast<std::size_t>(p)]; }
+
+    /**
+     * Choose the queue to take the next task from. The highest class
+     * goes first unless a lower one has been passed `limit` times.
+     * Queues must not be empty.
+     *
+     * @param limit see WorkerPoolOptions::starvation_limit
+     * @return the queue chosen
+     */
+    Queue& pick(unsigned limit) {
+        std::size_t chosen = 0;
+        while (queues[chosen].empty()) { ++chosen; }
+        // the lowest starving class is the longest waiting one
+        for (std::size_t c = priority_classes - 1; limit && c > chosen; --c) {
+            if (!queues[c].empty() && passed[c] >= limit) {
+                chosen = c;
+                break;
+            }
+        }
+        for (std::size_t c = chosen + 1; c < priority_classes; ++c) {
+            if (!queues[c].empty()) { ++passed[c]; }
+        }
+        passed[chosen] = 0;
+        return queues[chosen];
+    }
+};
+
+/**
+ * Jobs deque owned by one worker in Scheduling::work_stealing mode.
+ * Owner takes jobs from the front, thieves from the back, so they
+ * meet only when the deque is almost empty.
+ * Aligned, so deques of different workers don't share a line.
+ */
+struct alignas(cache_line_size) LocalJobs {
+    /** Mutex for jobs. Contended only by the owner and a thief */
+    std::mutex m;
+    /** Container of tasks to perform, a deque per priority class */
+    PriorityQueues<TaskQueue> jobs;
 };
 
 /**
@@ -131,33 +755,229 @@ struct Job {
  * are acquired via `get_answer()`. Results are
  * guaranteed to be in the same order as jobs came.
  *
+ * Jobs may be set with a Priority. Workers take higher classes first,
+ * lower ones are still served now and then, see
+ * WorkerPoolOptions::starvation_limit. Answers are ordered within
+ * each class and taken with `get_answer(Priority)`.
+ *
+ * Jobs with any signature can be passed to `submit()`, which returns
+ * a future for the typed result instead of the ordered answers queue.
+ *
+ * Jobs are either taken from a single shared queue or are spread
+ * across per-worker deques with work stealing, see `Scheduling`.
+ * Ordered answers are delivered either via futures or via
+ * a preallocated ring, see `Completion`. Workers may be pinned
+ * to CPUs, see `Placement`.
+ *
  * Usage example:
  *
  *      WorkerPool worker_pool();
  *      worker_pool.set_job(my_job, {"s1", "s2", "s3"});
+ *      worker_pool.try_set_job(my_job, "s1", "s2", "s3");
  *      auto result = worker_pool.get_answer();
+ *      worker_pool.set_job(Priority::high, my_job, "s1", "s2", "s3");
+ *      auto urgent = worker_pool.get_answer(Priority::high);
+ *      auto sum = worker_pool.submit([](int a, int b) { return a + b; }, 1, 2);
+ *      sum.get();
  *      worker_pool.stop();
  */
 class WorkerPool {
     friend Worker;
+public:
+    /** Type of results returned by `get_answer()` */
+    using Answer = std::string;
+
+private:
     /** Type of jobs to be performed */
-    using Jobs = std::queue<Job::JobRequest>;
+    using Jobs = PriorityQueues<TaskQueue>;
+
+    /** Answers of a batch in Completion::batched mode */
+    struct AnswerGroup {
+        /** Answers in the order of the jobs */
+        std::vector<Answer> answers;
+        /** Exceptions thrown instead of the answers, null for the answers */
+        std::vector<std::exception_ptr> errors;
+        /** Jobs delivering the answers in the trace, empty if tracing was off */
+        std::vector<std::uint64_t> jobs;
+
+        /** Job delivering the answer at `index` in the trace, 0 if unknown */
+        std::uint64_t job(std::size_t index) const { return index < jobs.size() ? jobs[index] : 0; }
+    };
 
-    /** Queue for a results. External access via `get_answer()` */
-    std::queue<std::future<Job::JobResult>> results;
+    /**
+     * Batch being done in Completion::batched mode. Every job writes
+     * its own place, the last one publishes the group and deletes it.
+     */
+    struct PendingGroup {
+        /** Ring of the priority class */
+        ResultRing<AnswerGroup>& ring;
+        /** Sequence number of the group in the ring */
+        const std::uint64_t seq;
+        /** Answers written by the jobs */
+        AnswerGroup group;
+        /** Jobs not done yet */
+        std::atomic<std::size_t> left;
+
+        /** A constructor, reserves the place in the ring */
+        PendingGroup(ResultRing<AnswerGroup>& r, std::size_t n) : PendingGroup(r, r.reserve(), n) {}
+
+        /** A constructor, for the place reserved already */
+        PendingGroup(ResultRing<AnswerGroup>& r, std::uint64_t s, std::size_t n) : ring(r), seq(s), left(n) {
+            group.answers.resize(n);
+            group.errors.resize(n);
+            if (Tracer::enabled()) { group.jobs.resize(n); }
+        }
+
+        /** Store the answer of the job at `index` */
+        void done(std::size_t index, Answer&& answer) {
+            group.answers[index] = std::move(answer);
+            finish(index);
+        }
+
+        /** Store the exception of the job at `index` */
+        void fail(std::size_t index, std::exception_ptr error) {
+            group.errors[index] = std::move(error);
+            finish(index);
+        }
+
+    private:
+        /** Account the job at `index`, the last one publishes the answers */
+        void finish(std::size_t index) {
+            if (!group.jobs.empty()) { group.jobs[index] = Tracer::running_job(); }
+            if (left.fetch_sub(1, std::memory_order_acq_rel) != 1) { return; }
+            ring.publish(seq, std::move(group));
+            delete this;
+        }
+    };
+
+    /** Answers of one priority class, guarded by `m_results`, on lines of its own */
+    struct alignas(cache_line_size) Results {
+        /** Queue for a results. External access via `get_answer()` */
+        std::queue<std::future<Answer>> futures;
+        /** Jobs of `futures` in the trace, 0 where tracing was off */
+        std::queue<std::uint64_t> future_jobs;
+        /** Exception of a future taken by `get_answers()` after other answers, rethrown next */
+        std::exception_ptr deferred;
+        /** Ring for a results in Completion::ring mode, used instead of `futures` */
+        std::unique_ptr<ResultRing<Answer>> ring;
+        /** Ring for a results in Completion::batched mode, used instead of `futures` */
+        std::unique_ptr<ResultRing<AnswerGroup>> groups;
+        /** Group being taken in Completion::batched mode. Consumer side */
+        AnswerGroup current;
+        /** Next answer of `current` to take. Consumer side */
+        std::size_t current_pos = 0;
+        /** Done answers in Completion::unordered mode, in order of completion */
+        std::deque<TaggedAnswer<Answer>> done;
+        /** Exceptions thrown instead of the answers in `done`, null for the answers */
+        std::deque<std::exception_ptr> errors;
+        /** Jobs delivering the answers in `done` in the trace, see `Tracer::running_job()` */
+        std::deque<std::uint64_t> done_jobs;
+        /** Sequence number of the next job in Completion::unordered mode */
+        std::uint64_t next_seq = 0;
+        /** Jobs set and not done yet in Completion::unordered mode */
+        std::size_t in_flight = 0;
+        /** Number of answers taken in ordered modes, that's the sequence number of the next one */
+        std::uint64_t answers_taken = 0;
+        /** Condvar for consumers of the class */
+        std::condition_variable cv;
+    };
+
+    // Configuration, read-only after the constructor, so shared by everybody
+
+    /** Deliver answers as they are done, used instead of `futures` */
+    const bool unordered;
+    /** Jobs scheduling strategy */
+    const Scheduling scheduling;
+    /** Most workers the pool may have */
+    const unsigned max_workers;
+    /** Idling of the workers before parking */
+    const IdlePolicy idle;
+    /** See WorkerPoolOptions::starvation_limit */
+    const unsigned starvation_limit;
+    /** Collect counters for `stats()` */
+    const bool collect_stats;
+    /** High-water mark of `pending`, 0 for unbounded */
+    const std::size_t capacity;
+    /** Resizing of the pool by itself */
+    const AutoScale autoscale;
+    /** CPUs of every worker up to `max_workers`, empty if workers aren't pinned */
+    std::vector<CpuSlot> placement;
+    /**
+     * Per-worker jobs deques, used in Scheduling::work_stealing mode.
+     * Allocated for `max_workers` up front, so resizing doesn't move them.
+     */
+    std::vector<std::unique_ptr<LocalJobs>> local_jobs;
+    /** Jobs rings in Scheduling::lock_free mode, one per priority class */
+    std::array<std::unique_ptr<MpmcQueue<Task>>, priority_classes> lock_free_jobs;
+
+    // Producer side: the shared queue, producers push and workers take under its mutex
+
+    /** Mutex for jobs */
+    alignas(cache_line_size) std::mutex m_jobs;
     /** Container of tasks to perform */
     Jobs jobs;
     /** Condvar for jobs */
     std::condition_variable cv_jobs;
-    /** Mutex for jobs */
-    std::mutex m_jobs;
-    /** Condvar for results */
-    std::condition_variable cv_results;
+
+    // Counters changed by every push and every take, apart from the mutex,
+    // so the workers spinning on `pending` don't take its line away
+
+    /** Number of jobs queued and not taken by workers yet */
+    alignas(cache_line_size) std::atomic<std::size_t> pending{0};
+    /** Number of jobs queued or running, see `wait_idle()` */
+    std::atomic<std::size_t> unfinished{0};
+    /** Jobs of every class which didn't fit the ring and went to `jobs` */
+    std::array<std::atomic<std::size_t>, priority_classes> overflowed{};
+    /** Next deque for the jobs submitted outside of the pool */
+    std::atomic<unsigned> next_local{0};
+
+    // Read by every push and every finished job, changed only by threads
+    // going to sleep and by resizing
+
+    /** Number of workers parked on `cv_jobs` */
+    alignas(cache_line_size) std::atomic<unsigned> sleepers{0};
+    /** Number of threads sleeping on `cv_idle` */
+    std::atomic<unsigned> idle_waiters{0};
+    /** Number of producers sleeping on `cv_space` */
+    std::atomic<unsigned> space_waiters{0};
+    /** Number of running workers, new jobs go to their deques */
+    std::atomic<unsigned> active{0};
+    /** Number of deques ever used, thieves look into all of them */
+    std::atomic<unsigned> used_deques{0};
+
+    // Consumer side: workers deliver, consumers take
+
     /** Mutex for results */
-    std::mutex m_results;
+    alignas(cache_line_size) std::mutex m_results;
+    /** Answers of every priority class */
+    std::array<Results, priority_classes> results;
+
+    /** Counters shared by producers, consumers and workers, on lines of their own */
+    PoolCounters counters;
+
+    // Rarely used, apart from the rest
 
-    // has to be initialized last
-    /** Workers to process incoming tasks */
+    /** Mutex for the threads waiting for the pool to go idle */
+    alignas(cache_line_size) std::mutex m_idle;
+    /** Condvar for the threads waiting for the pool to go idle */
+    std::condition_variable cv_idle;
+    /** Condvar for producers waiting for the queues to drain */
+    std::condition_variable cv_space;
+    /** Mutex for producers waiting for the queues to drain */
+    std::mutex m_space;
+    /** Mutex for the auto-scaling thread */
+    std::mutex m_scaler;
+    /** Condvar for the auto-scaling thread to stop */
+    std::condition_variable cv_scaler;
+    /** Auto-scaling thread has to exit */
+    bool scaler_stop = false;
+    /** Thread checking the load, runs if auto-scaling is enabled */
+    std::thread scaler;
+    /** Mutex for `workers` and `retired_stats` */
+    mutable std::mutex m_workers;
+    /** Counters of the workers which left the pool */
+    WorkerStats retired_stats;
+    /** Workers to process incoming tasks, index in the vector is the worker's index */
     std::vector<std::unique_ptr<Worker>> workers;
 
 public:
@@ -171,13 +991,63 @@ public:
      *
      * @param num_threads number of workers to start for \
      *  parallel processing
+     * @param sched jobs scheduling strategy
+     */
+    WorkerPool(unsigned num_threads = nthreads, Scheduling sched = Scheduling::fifo)
+            : WorkerPool(num_threads, WorkerPoolOptions{sched}) {}
+
+    /**
+     * A constructor.
+     *
+     * Starts workers.
+     *
+     * @param num_threads number of workers to start for \
+     *  parallel processing
+     * @param options tunables of the pool
      */
-    WorkerPool(unsigned num_threads = nthreads) {
-        SafeCout() << "WorkerPool start with " << num_threads << " threads" << std::endl;
+    WorkerPool(unsigned num_threads, const WorkerPoolOptions& options)
+            : unordered(options.completion == Completion::unordered),
+              scheduling(options.scheduling),
+              max_workers(std::max(num_threads, options.max_threads ? options.max_threads
+                                                                    : std::max(1u, nthreads))),
+              idle(options.idle),
+              starvation_limit(options.starvation_limit),
+              collect_stats(options.stats),
+              capacity(options.queue_capacity),
+              autoscale(options.autoscale) {
+        if (options.verbose) {
+            std::cout << "WorkerPool start with " << num_threads << " threads" << std::endl;
+        }
+
+        if (options.completion == Completion::ring) {
+            for (auto& res : results) { res.ring = std::make_unique<ResultRing<Answer>>(options.ring_size); }
+        }
+        if (options.completion == Completion::batched) {
+            for (auto& res : results) { res.groups = std::make_unique<ResultRing<AnswerGroup>>(options.ring_size); }
+        }
+
+        const auto slots = placement_slots(options.placement);
+        for (unsigned i = 0; i < max_workers && !slots.empty(); ++i) {
+            placement.push_back(slots[(options.placement_offset + i) % slots.size()]);
+        }
 
-        workers.reserve(num_threads);
-        for (unsigned i = 0; i < num_threads; ++i) {
-            workers.emplace_back(std::make_unique<Worker>(*this));
+        if (scheduling == Scheduling::work_stealing) {
+            // deques have to exist before any worker starts stealing
+            local_jobs.reserve(max_workers);
+            for (unsigned i = 0; i < max_workers; ++i) {
+                local_jobs.emplace_back(std::make_unique<LocalJobs>());
+            }
+        }
+
+        if (scheduling == Scheduling::lock_free) {
+            for (auto& q : lock_free_jobs) { q = std::make_unique<MpmcQueue<Task>>(options.lock_free_size); }
+        }
+
+        workers.reserve(max_workers);
+        resize(num_threads);
+
+        if (autoscale.enabled) {
+            scaler = std::thread(&WorkerPool::autoscale_loop, this);
         }
     }
 
@@ -189,17 +1059,353 @@ public:
      * it's done in workers destructors.
      */
     ~WorkerPool() {
-        for (auto& w : workers) { w->stop(); }
+        if (scaler.joinable()) {
+            {
+                std::lock_guard<std::mutex> l(m_scaler);
+                scaler_stop = true;
+            }
+            cv_scaler.notify_all();
+            scaler.join();
+        }
+
+        {
+            // under the lock, so no worker misses the wake up
+            std::lock_guard<std::mutex> l(m_jobs);
+            for (auto& w : workers) { w->stop(); }
+        }
         cv_jobs.notify_all();
     }
 
+    /**
+     * Grow or shrink the pool while it runs.
+     *
+     * New workers start right away. Leaving workers finish their
+     * current job and leave the shared queues to the others. In
+     * Scheduling::work_stealing mode a leaving worker first runs all the
+     * jobs of its own deque, nobody would take them after it. Nothing is
+     * dropped and the answers stay in order. Blocks until the leaving
+     * workers exit, which with work stealing takes as long as their
+     * deques, so it must not be called from a job.
+     *
+     * @param num_threads number of workers, clamped to [1, max_threads]
+     * @return number of workers
+     */
+    unsigned resize(unsigned num_threads);
+
+    /** Number of running workers */
+    unsigned size() const { return active.load(); }
+
     /**
      * Sets job to process.
      *
      * @param job job to be performed
      * @param args arguments to pass to the job
      */
-    void set_job(Job::JobFunc job, Job::JobArgs args);
+    void set_job(StringJob::JobFunc job, StringJob::JobArgs args) {
+        auto& [a, b, c] = args;
+        set_job(std::move(job), std::move(a), std::move(b), std::move(c));
+    }
+
+    /**
+     * Sets job to process. Its answer is acquired via `get_answer()`.
+     *
+     * @param job job to be performed, has to return `Answer`
+     * @param args arguments to pass to the job
+     */
+    template <typename F, typename... Args,
+              typename = std::enable_if_t<std::is_invocable_v<std::decay_t<F>&, std::decay_t<Args>...>>>
+    void set_job(F&& job, Args&&... args) {
+        set_job(Priority::normal, std::forward<F>(job), std::forward<Args>(args)...);
+    }
+
+    /**
+     * Sets job of the priority class to process.
+     * Its answer is acquired via `get_answer(prio)`.
+     *
+     * @param prio priority class of the job
+     * @param job job to be performed, has to return `Answer`
+     * @param args arguments to pass to the job
+     */
+    template <typename F, typename... Args,
+              typename = std::enable_if_t<std::is_invocable_v<std::decay_t<F>&, std::decay_t<Args>...>>>
+    void set_job(Priority prio, F&& job, Args&&... args) {
+        using J = Job<std::decay_t<F>, std::decay_t<Args>...>;
+        static_assert(std::is_same_v<typename J::JobResult, Answer>,
+                      "set_job() accepts jobs returning Answer, use submit() for others");
+
+        wait_for_space();
+        queue_job<J>(prio, false, std::forward<F>(job), std::forward<Args>(args)...);
+    }
+
+    /**
+     * Sets job to process if the queues are below the high-water mark.
+     * Never blocks, unlike `set_job()`: neither on the full queues
+     * nor on the full ring of answers in the ring modes.
+     *
+     * @param job job to be performed, has to return `Answer`
+     * @param args arguments to pass to the job, moved from only on success
+     * @return false if the queues or the ring are full and the job is not set
+     */
+    template <typename F, typename... Args,
+              typename = std::enable_if_t<std::is_invocable_v<std::decay_t<F>&, std::decay_t<Args>...>>>
+    bool try_set_job(F&& job, Args&&... args) {
+        return try_set_job(Priority::normal, std::forward<F>(job), std::forward<Args>(args)...);
+    }
+
+    /**
+     * Sets job of the priority class if there is space, see `try_set_job()`.
+     *
+     * @param prio priority class of the job
+     * @param job job to be performed, has to return `Answer`
+     * @param args arguments to pass to the job, moved from only on success
+     * @return false if the queues or the ring are full and the job is not set
+     */
+    template <typename F, typename... Args,
+              typename = std::enable_if_t<std::is_invocable_v<std::decay_t<F>&, std::decay_t<Args>...>>>
+    bool try_set_job(Priority prio, F&& job, Args&&... args) {
+        using J = Job<std::decay_t<F>, std::decay_t<Args>...>;
+        static_assert(std::is_same_v<typename J::JobResult, Answer>,
+                      "try_set_job() accepts jobs returning Answer, use submit() for others");
+
+        if (!admit()) { return false; }
+        if (!queue_job<J>(prio, true, std::forward<F>(job), std::forward<Args>(args)...)) {
+            taken();
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * Sets a batch of jobs to process with the same job function.
+     * Answers are acquired via `get_answer()` in the order of the range.
+     *
+     * All jobs and all answers are queued under a single lock each,
+     * and workers are woken once for the whole batch.
+     *
+     * @param job job to be performed, has to return `Answer`
+     * @param first beginning of the range of tuple-like arguments packs. \
+     *  Pass move iterators to move arguments instead of copying them.
+     * @param last end of the range
+     */
+    template <typename F, typename It>
+    void set_jobs(F&& job, It first, It last) {
+        set_jobs(Priority::normal, std::forward<F>(job), first, last);
+    }
+
+    /**
+     * Sets a batch of jobs of the priority class, see `set_jobs()`.
+     * Answers are acquired via `get_answer(prio)` in the order of the range.
+     *
+     * @param prio priority class of the jobs
+     * @param job job to be performed, has to return `Answer`
+     * @param first beginning of the range of tuple-like arguments packs
+     * @param last end of the range
+     */
+    template <typename F, typename It>
+    void set_jobs(Priority prio, F&& job, It first, It last) {
+        using J = typename JobFor<std::decay_t<F>,
+                                  typename std::iterator_traits<It>::value_type>::type;
+        static_assert(std::is_same_v<typename J::JobResult, Answer>,
+                      "set_jobs() accepts jobs returning Answer, use submit() for others");
+
+        wait_for_space();
+        auto& res = answers(prio);
+        std::vector<Task> tasks;
+        std::vector<std::future<Answer>> futures;
+        if constexpr (std::is_base_of_v<std::forward_iterator_tag,
+                          typename std::iterator_traits<It>::iterator_category>) {
+            const auto n = static_cast<std::size_t>(std::distance(first, last));
+            tasks.reserve(n);
+            if (!res.ring && !res.groups && !unordered) { futures.reserve(n); }
+        }
+
+        if (res.ring) {
+            for (; first != last; ++first) {
+                // already reserved slots have to be processed to free the ring
+                if (res.ring->full() && !tasks.empty()) {
+                    push(std::move(tasks), prio);
+                    tasks.clear();
+                }
+                tasks.push_back(ring_task<J>(*res.ring, res.ring->reserve(), job, J::pack(*first)));
+            }
+            if (!tasks.empty()) { push(std::move(tasks), prio); }
+            return;
+        }
+
+        if (res.groups) {
+            std::vector<typename J::JobArgs> packs;
+            for (; first != last; ++first) { packs.push_back(J::pack(*first)); }
+            if (packs.empty()) { return; }
+            auto* group = new PendingGroup(*res.groups, packs.size());
+            for (std::size_t i = 0; i < packs.size(); ++i) {
+                tasks.push_back(batch_task<J>(*group, i, job, std::move(packs[i])));
+            }
+            push(std::move(tasks), prio);
+            return;
+        }
+
+        if (unordered) {
+            std::vector<typename J::JobArgs> packs;
+            for (; first != last; ++first) { packs.push_back(J::pack(*first)); }
+            if (packs.empty()) { return; }
+            auto seq = reserve_seq(res, packs.size());
+            for (auto& p : packs) { tasks.push_back(unordered_task<J>(res, seq++, job, std::move(p))); }
+            push(std::move(tasks), prio);
+            return;
+        }
+
+        for (; first != last; ++first) {
+            auto request = std::apply([&job](auto&&... args) {
+                return J::make(job, std::forward<decltype(args)>(args)...);
+            }, *first);
+            futures.push_back(J::promise(request).get_future());
+            tasks.emplace_back(PromiseTask<J>{std::move(request)});
+        }
+        if (tasks.empty()) { return; }
+        if (Tracer::enabled()) {
+            auto id = Tracer::take_ids(tasks.size());
+            for (auto& t : tasks) { t.trace_id = id++; }
+        }
+
+        {
+            std::unique_lock<std::mutex> l(m_results, std::defer_lock);
+            lock_counted(l, results_lock_wait());
+            for (auto& f : futures) { res.futures.push(std::move(f)); }
+            for (const auto& t : tasks) { res.future_jobs.push(t.trace_id); }
+        }
+        res.cv.notify_all();
+
+        push(std::move(tasks), prio);
+    }
+
+    /**
+     * Answer taking its place among the answers of `set_job()` now
+     * and delivered later, by a job finishing the work of other jobs.
+     * Move-only. Has to be delivered once, the consumer waits for it.
+     * Destroyed undelivered, e.g. with the job discarded by `cancel()`,
+     * it delivers JobCancelled.
+     */
+    class PendingAnswer {
+        friend WorkerPool;
+        /** Pool of the answer */
+        WorkerPool* pool;
+        /** Answers of the priority class, null once delivered or moved from */
+        Results* res;
+        /** Sequence number in Completion::ring and Completion::unordered modes */
+        std::uint64_t seq = 0;
+        /** Batch of one in Completion::batched mode */
+        PendingGroup* group = nullptr;
+        /** Promise in Completion::futures mode */
+        std::promise<Answer> promise;
+
+        /** A constructor. Used by the pool */
+        PendingAnswer(WorkerPool& p, Results& r) : pool(&p), res(&r) {}
+
+    public:
+        /** Move the answer */
+        PendingAnswer(PendingAnswer&& other) noexcept
+                : pool(other.pool), res(std::exchange(other.res, nullptr)), seq(other.seq),
+                  group(other.group), promise(std::move(other.promise)) {}
+        /** Forbid this. The answer has a single owner */
+        PendingAnswer& operator=(PendingAnswer&&) = delete;
+
+        /** A destructor. Delivers JobCancelled if not delivered */
+        ~PendingAnswer() {
+            if (res) { fail(std::make_exception_ptr(JobCancelled())); }
+        }
+
+        /** Deliver the answer to `get_answer()`, may be called from any thread */
+        void deliver(Answer&& answer) {
+            auto* r = std::exchange(res, nullptr);
+            if (group) {
+                group->done(0, std::move(answer));
+            } else if (r->ring) {
+                r->ring->publish(seq, std::move(answer), Tracer::running_job());
+            } else if (pool->unordered) {
+                pool->complete(*r, seq, std::move(answer));
+            } else {
+                promise.set_value(std::move(answer));
+            }
+        }
+
+        /** Deliver the exception instead, `get_answer()` rethrows it */
+        void fail(std::exception_ptr error) {
+            auto* r = std::exchange(res, nullptr);
+            if (group) {
+                group->fail(0, std::move(error));
+            } else if (r->ring) {
+                r->ring->fail(seq, std::move(error), Tracer::running_job());
+            } else if (pool->unordered) {
+                pool->complete(*r, seq, Answer(), std::move(error));
+            } else {
+                promise.set_exception(std::move(error));
+            }
+        }
+    };
+
+    /**
+     * Reserve the place of an answer, see PendingAnswer.
+     * Blocks while the ring is full in Completion::ring mode.
+     *
+     * @param prio priority class of the answer
+     */
+    PendingAnswer reserve_answer(Priority prio = Priority::normal);
+
+    /**
+     * Runs the callable on a worker. Nothing is returned, so no promise
+     * is made, cheaper than `submit()`. Used to resume coroutines,
+     * see worker_pool_coro.hpp.
+     *
+     * @param f callable without arguments, must not throw
+     */
+    template <typename F>
+    void post(F&& f) { post(Priority::normal, std::forward<F>(f)); }
+
+    /**
+     * Runs the callable of the priority class on a worker, see `post()`.
+     *
+     * @param prio priority class of the job
+     * @param f callable without arguments, must not throw
+     */
+    template <typename F>
+    void post(Priority prio, F&& f) {
+        wait_for_space();
+        push(Task(std::forward<F>(f)), prio);
+    }
+
+    /**
+     * Submits job to process. Its result doesn't go to `get_answer()`,
+     * it is returned via the future instead.
+     *
+     * @param job job to be performed
+     * @param args arguments to pass to the job
+     * @return future for the result of the job
+     */
+    template <typename F, typename... Args>
+    auto submit(F&& job, Args&&... args)
+            -> std::future<std::invoke_result_t<std::decay_t<F>&, std::decay_t<Args>...>> {
+        return submit(Priority::normal, std::forward<F>(job), std::forward<Args>(args)...);
+    }
+
+    /**
+     * Submits job of the priority class, see `submit()`.
+     *
+     * @param prio priority class of the job
+     * @param job job to be performed
+     * @param args arguments to pass to the job
+     * @return future for the result of the job
+     */
+    template <typename F, typename... Args>
+    auto submit(Priority prio, F&& job, Args&&... args)
+            -> std::future<std::invoke_result_t<std::decay_t<F>&, std::decay_t<Args>...>> {
+        using J = Job<std::decay_t<F>, std::decay_t<Args>...>;
+
+        wait_for_space();
+        auto request = J::make(std::forward<F>(job), std::forward<Args>(args)...);
+        auto future = J::promise(request).get_future();
+        push(Task(PromiseTask<J>{std::move(request)}), prio);
+        return future;
+    }
 
     /**
      * Acquiring the result of the job. Blocking.
@@ -207,20 +1413,135 @@ public:
      * The only way to return from the blocking is either
      * get the job done or stop worker pool.
      *
+     * In Completion::unordered mode returns answers in order
+     * they are done instead.
+     *
+     * If the job has thrown, its exception is rethrown here in place
+     * of its answer, the next call returns the next answer.
+     *
+     * @param prio priority class the jobs were set with
      * @return result of the operation or an empty
      *  optional if worker pool is stopped.
      */
-    std::optional<Job::JobResult> get_answer();
+    std::optional<Answer> get_answer(Priority prio = Priority::normal);
+
+    /**
+     * Same as `get_answer()`, with the sequence number of the job.
+     * Jobs of each priority class are numbered separately.
+     *
+     * Exceptions of the jobs are rethrown the same way.
+     *
+     * @param prio priority class the jobs were set with
+     * @return result of the operation with its job number or an empty
+     *  optional if worker pool is stopped.
+     */
+    std::optional<TaggedAnswer<Answer>> get_tagged_answer(Priority prio = Priority::normal);
+
+    /**
+     * Take all the answers ready, in the same order as `get_answer()`.
+     * Blocks until there is at least one, then takes the rest without
+     * waiting, so the consumer wakes up once for many answers.
+     * Takes whole batches in Completion::batched mode.
+     *
+     * An answer replaced by an exception ends the answers taken,
+     * the exception is rethrown when it's the first one.
+     *
+     * @param out where to append the answers
+     * @param max most answers to take
+     * @param prio priority class the jobs were set with
+     * @return number of answers taken, 0 if worker pool is stopped
+     */
+    std::size_t get_answers(std::vector<Answer>& out, std::size_t max = std::numeric_limits<std::size_t>::max(),
+                            Priority prio = Priority::normal);
+
+    /**
+     * Buffer for an answer, reuses the memory of the recycled ones.
+     * Jobs writing their answers into it don't allocate once
+     * the consumer recycles answers at the pace they come.
+     *
+     * @return empty string, may have some capacity
+     */
+    static Answer answer_buffer() {
+        Answer buffer;
+        if (AnswerBuffers::acquire(buffer)) { buffer.clear(); }
+        return buffer;
+    }
+
+    /**
+     * Give the consumed answer back for `answer_buffer()`.
+     * May be called from any thread.
+     */
+    static void recycle(Answer&& answer) {
+        // short answers live in the string itself, nothing to recycle
+        if (answer.capacity() > Answer().capacity()) { AnswerBuffers::release(std::move(answer)); }
+    }
+
+    /**
+     * Snapshot of the counters. Counters are collected only
+     * with WorkerPoolOptions::stats set, see PoolStats::enabled.
+     */
+    PoolStats stats() const;
+
+    /**
+     * Block until no job is queued or running.
+     * Jobs may keep coming meanwhile, it waits for them too.
+     * Must not be called from a job.
+     */
+    void wait_idle();
+
+    /**
+     * Same as `wait_idle()`, up to the timeout.
+     *
+     * @param timeout longest time to wait
+     * @return false if some job is still queued or running
+     */
+    bool wait_idle(std::chrono::milliseconds timeout);
+
+    /**
+     * Discard the queued jobs without running them and return right away.
+     * Their answers (and futures of `submit()`) get JobCancelled,
+     * callables of `post()` are destroyed or get their cancel hook called,
+     * see Task. Running jobs are not interrupted. Jobs set meanwhile
+     * may escape it, the pool takes jobs after it as usual.
+     *
+     * @return number of jobs discarded
+     */
+    std::size_t cancel();
+
+    /**
+     * Finish the jobs, then `stop()`. Jobs still queued at the deadline
+     * are cancelled, the running ones are finished. Must not be called from a job.
+     *
+     * @param timeout longest time to wait for the jobs
+     * @return true if all jobs were done in time
+     */
+    bool drain(std::chrono::milliseconds timeout) {
+        const bool done = wait_idle(timeout);
+        if (!done) { cancel(); }
+        stop();
+        return done;
+    }
 
     /**
      * Stop worker pool and release all waiters from blocking.
      */
     void stop() {
-        stop_flag.store(true);
-        cv_results.notify_all();
+        {
+            // under the lock, so no waiter misses the wake up
+            std::lock_guard<std::mutex> l(m_results);
+            stop_flag.store(true);
+        }
+        for (auto& res : results) {
+            res.cv.notify_all();
+            if (res.ring) { res.ring->close(); }
+            if (res.groups) { res.groups->close(); }
+        }
     }
 
 private:
+    /** Recycled answers */
+    using AnswerBuffers = Recycler<Answer, WorkerPool>;
+
     /** Flag for stopping the waiters */
     std::atomic<bool> stop_flag{false};
     /** Get jobs mutex  */
@@ -229,5 +1550,261 @@ private:
     std::condition_variable& get_condvar() { return cv_jobs; }
     /** Get jobs  */
     Jobs& get_jobs() { return jobs; }
+    /** Answers of the priority class */
+    Results& answers(Priority prio) { return results[static_cast<std::size_t>(prio)]; }
+
+    /**
+     * Queue the job of `set_job()` with the place of its answer.
+     *
+     * @param prio priority class of the job
+     * @param admitted the job is counted in `pending` by `admit()` already, \
+     *  see `try_set_job()`: the ring of answers isn't waited for then
+     * @param job job to be performed
+     * @param args arguments to pass to the job
+     * @return false if the job is admitted and the ring of answers is full
+     */
+    template <typename J, typename F, typename... Args>
+    bool queue_job(Priority prio, bool admitted, F&& job, Args&&... args) {
+        auto& res = answers(prio);
+        if (res.ring) {
+            const auto seq = admitted ? res.ring->try_reserve() : res.ring->reserve();
+            if (!seq) { return false; }
+            push(ring_task<J>(*res.ring, *seq, std::forward<F>(job),
+                              typename J::JobArgs(std::forward<Args>(args)...)), prio, admitted);
+            return true;
+        }
+        if (res.groups) {
+            const auto seq = admitted ? res.groups->try_reserve() : res.groups->reserve();
+            if (!seq) { return false; }
+            // a batch of one
+            push(batch_task<J>(*new PendingGroup(*res.groups, *seq, 1), 0, std::forward<F>(job),
+                               typename J::JobArgs(std::forward<Args>(args)...)), prio, admitted);
+            return true;
+        }
+        if (unordered) {
+            push(unordered_task<J>(res, reserve_seq(res, 1), std::forward<F>(job),
+                                   typename J::JobArgs(std::forward<Args>(args)...)), prio, admitted);
+            return true;
+        }
+
+        auto request = J::make(std::forward<F>(job), std::forward<Args>(args)...);
+        auto future = J::promise(request).get_future();
+        // the consumer can't learn the job from the future, so it's numbered now
+        Task task(PromiseTask<J>{std::move(request)});
+        if (Tracer::enabled()) { task.trace_id = Tracer::take_ids(1); }
+
+        {
+            std::unique_lock<std::mutex> l(m_results, std::defer_lock);
+            lock_counted(l, results_lock_wait());
+            res.futures.push(std::move(future));
+            res.future_jobs.push(task.trace_id);
+        }
+        res.cv.notify_one();
+
+        push(std::move(task), prio, admitted);
+        return true;
+    }
+
+    /**
+     * Make a task writing the answer to the ring slot.
+     *
+     * @param ring ring of the priority class of the job
+     * @param seq sequence number of the reserved slot
+     * @param job job to be performed
+     * @param args arguments to pass to the job
+     */
+    template <typename J, typename F>
+    static Task ring_task(ResultRing<Answer>& ring, std::uint64_t seq, F&& job, typename J::JobArgs&& args) {
+        /** Job publishing to the slot, cancelling it publishes JobCancelled */
+        struct RingTask {
+            ResultRing<Answer>& ring;
+            std::uint64_t seq;
+            typename J::JobFunc func;
+            typename J::JobArgs call_args;
+
+            void operator()() {
+                J::call(func, call_args,
+                        [this](Answer&& answer) { ring.publish(seq, std::move(answer), Tracer::running_job()); },
+                        [this](std::exception_ptr e) { ring.fail(seq, std::move(e), Tracer::running_job()); });
+            }
+            void cancel() { ring.fail(seq, std::make_exception_ptr(JobCancelled()), Tracer::running_job()); }
+        };
+        return Task(RingTask{ring, seq, typename J::JobFunc(std::forward<F>(job)), std::move(args)});
+    }
+
+    /**
+     * Make a task writing the answer to its place in the group.
+     *
+     * @param group answers of the batch of the job
+     * @param index place of the job in the batch
+     * @param job job to be performed
+     * @param args arguments to pass to the job
+     */
+    template <typename J, typename F>
+    static Task batch_task(PendingGroup& group, std::size_t index, F&& job, typename J::JobArgs&& args) {
+        /** Job writing to the group, cancelling it writes JobCancelled */
+        struct BatchTask {
+            PendingGroup& group;
+            std::size_t index;
+            typename J::JobFunc func;
+            typename J::JobArgs call_args;
+
+            void operator()() {
+                J::call(func, call_args, [this](Answer&& answer) { group.done(index, std::move(answer)); },
+                        [this](std::exception_ptr e) { group.fail(index, std::move(e)); });
+            }
+            void cancel() { group.fail(index, std::make_exception_ptr(JobCancelled())); }
+        };
+        return Task(BatchTask{group, index, typename J::JobFunc(std::forward<F>(job)), std::move(args)});
+    }
+
+    /**
+     * Make a task putting the answer to the done answers.
+     *
+     * @param res answers of the priority class of the job
+     * @param seq sequence number of the job
+     * @param job job to be performed
+     * @param args arguments to pass to the job
+     */
+    template <typename J, typename F>
+    Task unordered_task(Results& res, std::uint64_t seq, F&& job, typename J::JobArgs&& args) {
+        /** Job completing the answer, cancelling it completes JobCancelled */
+        struct UnorderedTask {
+            WorkerPool& pool;
+            Results& res;
+            std::uint64_t seq;
+            typename J::JobFunc func;
+            typename J::JobArgs call_args;
+
+            void operator()() {
+                J::call(func, call_args, [this](Answer&& answer) { pool.complete(res, seq, std::move(answer)); },
+                        [this](std::exception_ptr e) { pool.complete(res, seq, Answer(), std::move(e)); });
+            }
+            void cancel() { pool.complete(res, seq, Answer(), std::make_exception_ptr(JobCancelled())); }
+        };
+        return Task(UnorderedTask{*this, res, seq, typename J::JobFunc(std::forward<F>(job)), std::move(args)});
+    }
+
+    /**
+     * Number `n` jobs in Completion::unordered mode.
+     *
+     * @param res answers of the priority class of the jobs
+     * @return sequence number of the first one
+     */
+    std::uint64_t reserve_seq(Results& res, std::size_t n);
+    /**
+     * Deliver the answer in Completion::unordered mode.
+     *
+     * @param res answers of the priority class of the job
+     * @param seq sequence number of the job
+     * @param answer answer of the job
+     * @param error exception thrown by the job instead of the answer, if any
+     */
+    void complete(Results& res, std::uint64_t seq, Answer&& answer, std::exception_ptr error = nullptr);
+
+    /** Check if the counters are collected */
+    bool stats_enabled() const { return WORKER_POOL_STATS && collect_stats; }
+    /** Counter of waiting for `m_jobs` by producers, nullptr if not collected */
+    std::atomic<std::uint64_t>* jobs_lock_wait() {
+        return stats_enabled() ? &counters.jobs_lock_wait : nullptr;
+    }
+    /** Counter of waiting for `m_results`, nullptr if not collected */
+    std::atomic<std::uint64_t>* results_lock_wait() {
+        return stats_enabled() ? &counters.results_lock_wait : nullptr;
+    }
+    /** Account the jobs being queued */
+    void queued(Task& task, std::size_t depth);
+    /** Account the jobs being queued */
+    void queued(std::vector<Task>& tasks, std::size_t depth);
+    /**
+     * Take the number of the next ordered answer of the class, tracing it.
+     *
+     * @param res answers of the priority class
+     * @param job job which delivered the answer in the trace
+     */
+    std::uint64_t consumed(Results& res, std::uint64_t job) {
+        Tracer::record(TraceEvent::consumed, job);
+        return res.answers_taken++;
+    }
+
+    /** Check if the queues have reached the high-water mark */
+    bool full() const { return capacity && pending.load() >= capacity; }
+
+    /**
+     * Count a job in `pending` unless the queues are full, at once,
+     * so producers racing for the last place don't both take it.
+     *
+     * @return false if the queues have reached the high-water mark
+     */
+    bool admit() {
+        auto n = pending.load();
+        do {
+            if (capacity && n >= capacity) { return false; }
+        } while (!pending.compare_exchange_weak(n, n + 1));
+        return true;
+    }
+
+    /**
+     * Block while the queues are full.
+     * Jobs submitted from workers are always admitted, otherwise
+     * the workers could block each other with nobody to drain the queues.
+     */
+    void wait_for_space();
+    /** Account `n` jobs taken by workers or cancelled, release the producers if drained */
+    void taken(std::size_t n = 1);
+    /** Account `n` jobs done or cancelled, release the `wait_idle()` waiters if none is left */
+    void finished(std::size_t n = 1);
+
+    /** Auto-scaling thread function */
+    void autoscale_loop();
+
+    /**
+     * Push task to the queue of its class selected by scheduling strategy.
+     *
+     * @param task the task
+     * @param prio priority class of the task
+     * @param counted the task is counted in `pending` by `admit()` already
+     */
+    void push(Task&& task, Priority prio, bool counted = false);
+    /** Push tasks to the queue of their class selected by scheduling strategy */
+    void push(std::vector<Task>&& tasks, Priority prio);
+    /** Push task to the local deque of a worker, see `push()` */
+    void push_local(Task&& task, Priority prio, bool counted);
+    /** Spread tasks across the local deques of the workers */
+    void push_local(std::vector<Task>&& tasks, Priority prio);
+    /** Index of the local deque for tasks submitted by the current thread */
+    unsigned local_index();
+    /** NUMA node of the worker, 0 if workers aren't pinned */
+    unsigned node(unsigned index) const { return placement.empty() ? 0 : placement[index].node; }
+    /** Wake up to `n` parked workers */
+    void wake(std::size_t n);
+    /** Notify up to `n` of `parked` workers, jobs have to be pushed under `m_jobs` */
+    void notify(std::size_t n, unsigned parked);
+    /**
+     * Take a job from the own deque or steal one from others.
+     *
+     * @param index index of the worker looking for a job
+     * @param task where to put the job
+     * @param steal look into the deques of others if the own one is empty
+     * @return true if job is found
+     */
+    bool pop_local(unsigned index, Task& task, bool steal = true);
+    /** Push task to the lock-free ring of its class, to `jobs` if the ring is full */
+    void push_lock_free(Task&& task, Priority prio);
+    /** Check if the class may have jobs in Scheduling::lock_free mode */
+    bool has_lock_free_jobs(std::size_t c) const {
+        return !lock_free_jobs[c]->empty() || overflowed[c].load() > 0;
+    }
+    /** Take a job of the class from its ring or from `jobs` */
+    bool pop_lock_free(std::size_t c, Task& task);
+    /**
+     * Take a job in Scheduling::lock_free mode, choosing the class
+     * the way PriorityQueues::pick() does.
+     *
+     * @param passed anti-starvation counters of the worker
+     * @param task where to put the job
+     * @return true if job is found
+     */
+    bool pop_lock_free(std::array<unsigned, priority_classes>& passed, Task& task);
 };
 
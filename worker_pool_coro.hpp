@@ -0,0 +1,424 @@
+/**
+ * @file worker_pool_coro.hpp
+ * @author Albert Kharisov <albkharisov@gmail.com>
+ * @version 1.0
+ *
+ * @brief C++20 coroutine front-end of the worker pool.
+ *
+ * Coroutines suspend instead of blocking a thread: `co_await pool.schedule()`
+ * moves the coroutine to a worker, `co_await pool.submit(f, args...)`
+ * resumes it on the worker right after the job. Both go through
+ * the pool's queues via `WorkerPool::post()`.
+ *
+ * Usage example:
+ *
+ *      Coro<int> solve(CoroPool& pool, int x) {
+ *          co_await pool.schedule();
+ *          int y = co_await pool.submit([](int a) { return a * 2; }, x);
+ *          co_return y + 1;
+ *      }
+ *
+ *      WorkerPool workers;
+ *      CoroPool pool(workers);
+ *      int result = sync_wait(solve(pool, 20));
+ *
+ * Frames of coroutines taking `CoroPool&` as the first parameter
+ * are allocated from the pool's FrameAllocator.
+ *
+ * Needs C++20, the rest of the pool is C++17.
+ */
+
+#pragma once
+
+#if __cplusplus >= 202002L && __has_include(<coroutine>)
+
+#include <array>
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <future>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include "worker_pool.hpp"
+
+/**
+ * @brief Recycling allocator of coroutine frames.
+ *
+ * Frames are rounded up to size classes, freed frames go to the free
+ * list of their class and are reused. Frames larger than the biggest
+ * class go to the global operator new. Memory is returned to the system
+ * when the allocator is destroyed, so it has to outlive the coroutines.
+ */
+class FrameAllocator {
+    /** Size class step */
+    static constexpr std::size_t granularity = 64;
+    /** Number of size classes, frames up to 1 KiB are recycled */
+    static constexpr std::size_t classes = 16;
+
+    /** Freed frame in the free list */
+    struct Node {
+        /** Next freed frame of the same class */
+        Node* next;
+    };
+
+    /** Mutex for free lists, frames are freed on the workers */
+    std::mutex m;
+    /** Freed frames of each size class */
+    std::array<Node*, classes> free_lists{};
+
+    /** Size class of the frame, `classes` if it's too big */
+    static std::size_t size_class(std::size_t size) { return (size + granularity - 1) / granularity - 1; }
+
+public:
+    /** A constructor */
+    FrameAllocator() = default;
+    /** Forbid this. Frames refer to the allocator */
+    FrameAllocator(const FrameAllocator&) = delete;
+    /** Forbid this. Frames refer to the allocator */
+    FrameAllocator& operator=(const FrameAllocator&) = delete;
+
+    /** A destructor. Releases all freed frames */
+    ~FrameAllocator() {
+        for (std::size_t c = 0; c < classes; ++c) {
+            while (auto* node = free_lists[c]) {
+                free_lists[c] = node->next;
+                ::operator delete(node, (c + 1) * granularity);
+            }
+        }
+    }
+
+    /** Allocate memory for a frame */
+    void* allocate(std::size_t size) {
+        const auto c = size_class(size);
+        if (c >= classes) { return ::operator new(size); }
+        {
+            std::lock_guard<std::mutex> l(m);
+            if (auto* node = free_lists[c]) {
+                free_lists[c] = node->next;
+                return node;
+            }
+        }
+        return ::operator new((c + 1) * granularity);
+    }
+
+    /** Return memory of a frame of the given size */
+    void deallocate(void* ptr, std::size_t size) noexcept {
+        const auto c = size_class(size);
+        if (c >= classes) {
+            ::operator delete(ptr, size);
+            return;
+        }
+        std::lock_guard<std::mutex> l(m);
+        free_lists[c] = new (ptr) Node{free_lists[c]};
+    }
+};
+
+class CoroPool;
+
+namespace coro_detail {
+
+/**
+ * Frame allocation of the coroutines. The allocator used is stored
+ * in front of the frame, so any frame can be freed in the same way.
+ */
+struct FramePromise {
+    /** Space in front of the frame for the allocator pointer */
+    static constexpr std::size_t header = alignof(std::max_align_t);
+
+    /**
+     * Allocate a frame from the allocator, nullptr for the global one.
+     * Not inlined: GCC can't see through the header and warns about
+     * mismatched new and delete otherwise. Without optimization it
+     * still does, build with -Wno-mismatched-new-delete then.
+     */
+    __attribute__((noinline)) static void* allocate(std::size_t size, FrameAllocator* allocator) {
+        auto* raw = static_cast<char*>(allocator ? allocator->allocate(size + header)
+                                                 : ::operator new(size + header));
+        *reinterpret_cast<FrameAllocator**>(raw) = allocator;
+        return raw + header;
+    }
+
+    /** Frame of a coroutine taking the CoroPool first (or of a CoroPool member) */
+    template <typename... Args>
+    static void* operator new(std::size_t size, CoroPool& pool, Args&...);
+
+    /** Frame of any other coroutine */
+    static void* operator new(std::size_t size) { return allocate(size, nullptr); }
+
+    /** Free the frame in the allocator it came from */
+    static void operator delete(void* ptr, std::size_t size) noexcept {
+        auto* raw = static_cast<char*>(ptr) - header;
+        auto* allocator = *reinterpret_cast<FrameAllocator**>(raw);
+        if (allocator) {
+            allocator->deallocate(raw, size + header);
+        } else {
+            ::operator delete(raw, size + header);
+        }
+    }
+};
+
+/** Result of a coroutine, value or exception */
+template <typename T>
+struct Result {
+    /** Returned value */
+    std::optional<T> value;
+    /** Exception escaped the coroutine */
+    std::exception_ptr error;
+
+    /** Store the result */
+    template <typename U>
+    void set(U&& v) { value.emplace(std::forward<U>(v)); }
+    /** Take the result, rethrows the exception */
+    T get() {
+        if (error) { std::rethrow_exception(error); }
+        return std::move(*value);
+    }
+};
+
+/** No result, only an exception */
+template <>
+struct Result<void> {
+    /** Exception escaped the coroutine */
+    std::exception_ptr error;
+
+    /** Take the result, rethrows the exception */
+    void get() {
+        if (error) { std::rethrow_exception(error); }
+    }
+};
+
+/** Promise part storing the returned value */
+template <typename T, typename Derived>
+struct ReturnValue {
+    /** co_return value */
+    template <typename U>
+    void return_value(U&& v) { static_cast<Derived*>(this)->result.set(std::forward<U>(v)); }
+};
+
+/** Promise part for coroutines returning nothing */
+template <typename Derived>
+struct ReturnValue<void, Derived> {
+    /** co_return */
+    void return_void() {}
+};
+
+/** Fire and forget coroutine, runs right away and frees itself */
+struct Detached {
+    /** Coroutine promise */
+    struct promise_type {
+        Detached get_return_object() noexcept { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() noexcept {}
+        void unhandled_exception() noexcept { std::terminate(); }
+    };
+};
+
+} // namespace coro_detail
+
+/**
+ * @brief Lazy coroutine returning `T`.
+ *
+ * Starts when awaited, the awaiter resumes when it's done,
+ * on the thread it's done on. Use `sync_wait()` at the top level.
+ */
+template <typename T = void>
+class [[nodiscard]] Coro {
+public:
+    /** Coroutine promise */
+    struct promise_type : coro_detail::FramePromise, coro_detail::ReturnValue<T, promise_type> {
+        /** Value or exception */
+        coro_detail::Result<T> result;
+        /** Coroutine awaiting this one */
+        std::coroutine_handle<> continuation;
+
+        /** Resume the awaiter when done */
+        struct FinalAwaiter {
+            bool await_ready() noexcept { return false; }
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> h) noexcept {
+                auto next = h.promise().continuation;
+                return next ? next : std::noop_coroutine();
+            }
+            void await_resume() noexcept {}
+        };
+
+        Coro get_return_object() noexcept {
+            return Coro(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        FinalAwaiter final_suspend() noexcept { return {}; }
+        void unhandled_exception() noexcept { result.error = std::current_exception(); }
+    };
+
+    /** Move the coroutine */
+    Coro(Coro&& other) noexcept : handle(std::exchange(other.handle, {})) {}
+    /** Forbid this. Coroutine has a single owner */
+    Coro(const Coro&) = delete;
+    /** Forbid this. Coroutine has a single owner */
+    Coro& operator=(const Coro&) = delete;
+    /** A destructor. Destroys the frame */
+    ~Coro() {
+        if (handle) { handle.destroy(); }
+    }
+
+    /** Start the coroutine and suspend until it's done */
+    auto operator co_await() noexcept {
+        struct Awaiter {
+            std::coroutine_handle<promise_type> handle;
+            bool await_ready() noexcept { return false; }
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+                handle.promise().continuation = awaiting;
+                return handle;
+            }
+            T await_resume() { return handle.promise().result.get(); }
+        };
+        return Awaiter{handle};
+    }
+
+private:
+    /** A constructor. Used by the promise */
+    explicit Coro(std::coroutine_handle<promise_type> h) noexcept : handle(h) {}
+
+    /** Frame of the coroutine */
+    std::coroutine_handle<promise_type> handle;
+};
+
+/**
+ * @brief Worker pool seen from coroutines.
+ *
+ * Owns the allocator of coroutine frames.
+ */
+class CoroPool {
+    /** Pool running the coroutines */
+    WorkerPool& pool;
+    /** Allocator of coroutine frames */
+    FrameAllocator frames;
+
+public:
+    /** A constructor. Has to be destroyed after all the coroutines */
+    explicit CoroPool(WorkerPool& workers) : pool(workers) {}
+
+    /** Allocator of coroutine frames */
+    FrameAllocator& allocator() { return frames; }
+
+    /**
+     * Awaitable moving the coroutine to a worker.
+     * If the pool cancels it, the coroutine is resumed by the canceller
+     * and JobCancelled is thrown from `co_await`.
+     */
+    auto schedule() {
+        struct Awaiter {
+            WorkerPool& pool;
+            bool cancelled = false;
+
+            /** Posted job resuming the coroutine */
+            struct Resume {
+                Awaiter* awaiter;
+                std::coroutine_handle<> h;
+                void operator()() { h.resume(); }
+                void cancel() {
+                    awaiter->cancelled = true;
+                    h.resume();
+                }
+            };
+
+            bool await_ready() noexcept { return false; }
+            void await_suspend(std::coroutine_handle<> h) { pool.post(Resume{this, h}); }
+            void await_resume() {
+                if (cancelled) { throw JobCancelled(); }
+            }
+        };
+        return Awaiter{pool};
+    }
+
+    /**
+     * Awaitable running the job on a worker. The coroutine
+     * is resumed on the same worker with the result of the job.
+     * If the pool cancels the job, JobCancelled is thrown instead.
+     *
+     * @param job job to be performed
+     * @param args arguments to pass to the job
+     */
+    template <typename F, typename... Args>
+    auto submit(F&& job, Args&&... args) {
+        using R = std::invoke_result_t<std::decay_t<F>&, std::decay_t<Args>...>;
+
+        struct Awaiter {
+            WorkerPool& pool;
+            std::decay_t<F> func;
+            std::tuple<std::decay_t<Args>...> call_args;
+            coro_detail::Result<R> result;
+
+            /** Posted job running the call and resuming the coroutine */
+            struct Resume {
+                Awaiter* awaiter;
+                std::coroutine_handle<> h;
+                void operator()() {
+                    if constexpr (Job<std::decay_t<F>, std::decay_t<Args>...>::nothrow) {
+                        awaiter->call();
+                    } else {
+                        try {
+                            awaiter->call();
+                        } catch (...) {
+                            awaiter->result.error = std::current_exception();
+                        }
+                    }
+                    h.resume();
+                }
+                void cancel() {
+                    awaiter->result.error = std::make_exception_ptr(JobCancelled());
+                    h.resume();
+                }
+            };
+
+            bool await_ready() noexcept { return false; }
+            void await_suspend(std::coroutine_handle<> h) { pool.post(Resume{this, h}); }
+            void call() {
+                if constexpr (std::is_void_v<R>) {
+                    std::apply(func, std::move(call_args));
+                } else {
+                    result.set(std::apply(func, std::move(call_args)));
+                }
+            }
+            R await_resume() { return result.get(); }
+        };
+        return Awaiter{pool, std::forward<F>(job), {std::forward<Args>(args)...}, {}};
+    }
+};
+
+template <typename... Args>
+void* coro_detail::FramePromise::operator new(std::size_t size, CoroPool& pool, Args&...) {
+    return allocate(size, &pool.allocator());
+}
+
+/**
+ * @brief Run the coroutine and block the current thread until it's done.
+ *
+ * @return result of the coroutine, its exception is rethrown
+ */
+template <typename T>
+T sync_wait(Coro<T> coro) {
+    std::promise<T> done;
+    auto result = done.get_future();
+    // the promise is owned by the frame, it may finish after we wake up
+    [](Coro<T>& c, std::promise<T> p) -> coro_detail::Detached {
+        try {
+            if constexpr (std::is_void_v<T>) {
+                co_await c;
+                p.set_value();
+            } else {
+                auto value = co_await c;
+                p.set_value(std::move(value));
+            }
+        } catch (...) {
+            p.set_exception(std::current_exception());
+        }
+    }(coro, std::move(done));
+    return result.get();
+}
+
+#endif // C++20 coroutines